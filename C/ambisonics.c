@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h> // for memset, memmove
+#include <stdlib.h>
+#include <math.h>
+#include <stdio.h>
+#include "ambisonics.h"
+#include "conv_kernels.h"
+
+#define AMBI_PI 3.14159265358979f
+
+/** Circular harmonics of the given order at azimuth a: [1, cos(a), sin(a), cos(2a), sin(2a), ...] */
+static void ambi_harmonics(int order, float azimuth, float *y) {
+  float a = azimuth * AMBI_PI / 180;
+  y[0] = 1;
+  for (int m = 1; m <= order; m++) {
+    y[2 * m - 1] = cosf(m * a);
+    y[2 * m] = sinf(m * a);
+  }
+}
+
+int ambi_bus_init(AmbiBus *bus, int order, const char *dataset_dir) {
+
+  if (bus == NULL || dataset_dir == NULL || order < 1 || order > AMBI_MAX_ORDER) {
+    return -1;
+  }
+
+  memset(bus, 0, sizeof(AmbiBus));
+  bus->order = order;
+  bus->numChannels = 2 * order + 1;
+
+  // max-rE weights narrow the decoded lobe and suppress the side lobes of the plain sampling decoder
+  float weight[AMBI_MAX_ORDER + 1];
+  for (int m = 0; m <= order; m++) {
+    weight[m] = cosf(m * AMBI_PI / (2 * order + 2));
+  }
+
+  for (int s = 0; s < AMBI_NUM_SPEAKERS; s++) {
+    int degrees = s * (360 / AMBI_NUM_SPEAKERS);
+    char filter_path[256];
+    snprintf(filter_path, sizeof(filter_path), "%s/%d_degrees.bin", dataset_dir, degrees);
+
+    FILE *f_file = fopen(filter_path, "rb");
+    if (f_file == NULL) {
+      perror("[ambisonics] Failed to open virtual speaker filter");
+      return -1;
+    }
+    // shorter filters than FILTER_SIZE are zero padded
+    float hrir[2][FILTER_SIZE] = {{0}};
+    fseek(f_file, 0, SEEK_END);
+    long len = ftell(f_file) / (2 * sizeof(float));
+    fseek(f_file, 0, SEEK_SET);
+    size_t taps = 0;
+    if (len >= 1 && len <= FILTER_SIZE) {
+      taps = fread(hrir[0], sizeof(float), len, f_file);
+      taps += fread(hrir[1], sizeof(float), len, f_file);
+    }
+    fclose(f_file);
+    if (taps != 2 * (size_t) len) {
+      return -1;
+    }
+
+    // Sampling decoder: speaker s gets (1/S) * (y0 + 2 * sum of the higher harmonics) at its own
+    // direction. Folding it into the speaker HRIRs leaves one filter per ambisonic channel and ear.
+    float y[AMBI_MAX_CHANNELS];
+    ambi_harmonics(order, (float) degrees, y);
+    for (int c = 0; c < bus->numChannels; c++) {
+      int m = (c + 1) / 2;
+      float gain = (c == 0 ? 1.0f : 2.0f) * weight[m] * y[c] / AMBI_NUM_SPEAKERS;
+      for (int ear = 0; ear < 2; ear++) {
+        for (int j = 0; j < FILTER_SIZE; j++) {
+          bus->decoder[ear][c][j] += gain * hrir[ear][j];
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+void ambi_bus_begin(AmbiBus *bus, int len) {
+  for (int c = 0; c < bus->numChannels; c++) {
+    memset(bus->bus[c] + (FILTER_SIZE - 1), 0, len * sizeof(float));
+  }
+}
+
+void ambi_encode(AmbiBus *bus, const float *mono, float azimuth, int len) {
+  float y[AMBI_MAX_CHANNELS];
+  ambi_harmonics(bus->order, azimuth, y);
+  for (int c = 0; c < bus->numChannels; c++) {
+    float *dest = bus->bus[c] + (FILTER_SIZE - 1);
+    for (int i = 0; i < len; i++) {
+      dest[i] += y[c] * mono[i];
+    }
+  }
+}
+
+void ambi_decode_binaural(AmbiBus *bus, float **out, int len) {
+
+  for (int ear = 0; ear < 2; ear++) {
+    memset(out[ear], 0, len * sizeof(float));
+    for (int c = 0; c < bus->numChannels; c++) {
+      conv_dispatch(bus->decoder[ear][c], FILTER_SIZE, 0, bus->bus[c], bus->convolved, FILTER_SIZE - 1, len);
+      for (int i = 0; i < len; i++) {
+        out[ear][i] += bus->convolved[(FILTER_SIZE - 1) + i];
+      }
+    }
+  }
+
+  // keep the last FILTER_SIZE - 1 samples of each channel as history for the next block
+  for (int c = 0; c < bus->numChannels; c++) {
+    memmove(bus->bus[c], bus->bus[c] + len, (FILTER_SIZE - 1) * sizeof(float));
+  }
+}
+
+void ambi_bus_filter(const AmbiBus *bus, float azimuth, BinauralFilter *filter) {
+  float y[AMBI_MAX_CHANNELS];
+  ambi_harmonics(bus->order, azimuth, y);
+  for (int ear = 0; ear < 2; ear++) {
+    for (int j = 0; j < FILTER_SIZE; j++) {
+      float tap = 0;
+      for (int c = 0; c < bus->numChannels; c++) {
+        tap += y[c] * bus->decoder[ear][c][j];
+      }
+      filter->taps[ear][j] = tap;
+    }
+    filter->len[ear] = FILTER_SIZE;
+    filter->delay[ear] = 0;
+  }
+}
+
+int binaural_compute_ambisonic(int num_sources, char** audio_files, const float* azimuths,
+    int order, const char* output_path) {
+
+  if (num_sources < 1 || audio_files == NULL || azimuths == NULL || output_path == NULL) {
+    return -1;
+  }
+
+  // per call state, so that renders may run concurrently
+  AmbiBus *bus = (AmbiBus *) malloc(sizeof(AmbiBus));
+  if (bus == NULL || ambi_bus_init(bus, order, "dataset_bin") != 0) {
+    free(bus);
+    return -1;
+  }
+
+  TinyWav *tw = (TinyWav *) calloc(num_sources, sizeof(TinyWav));
+  if (tw == NULL) {
+    free(bus);
+    return -1;
+  }
+
+  int opened = 0;
+  uint32_t frames = 0; // the output lasts as long as the longest source
+  for (; opened < num_sources; opened++) {
+    if (tinywav_open_read(&tw[opened], audio_files[opened], TW_SPLIT) != 0 || tw[opened].numChannels > 2) {
+      printf("[ambisonics] Cannot read %s as a mono or stereo wav\r\n", audio_files[opened]);
+      tinywav_close_read(&tw[opened]);
+      break;
+    }
+    // the bus has no resampler, every source must play at the output's rate
+    if (tw[opened].h.SampleRate != tw[0].h.SampleRate) {
+      printf("[ambisonics] %s is at %u Hz, %s at %u Hz\r\n", audio_files[opened], tw[opened].h.SampleRate,
+          audio_files[0], tw[0].h.SampleRate);
+      tinywav_close_read(&tw[opened]);
+      break;
+    }
+    if ((uint32_t) tw[opened].numFramesInHeader > frames) {
+      frames = (uint32_t) tw[opened].numFramesInHeader;
+    }
+  }
+
+  int res = -1;
+  TinyWav tw_out;
+  if (opened == num_sources
+      && tinywav_open_write(&tw_out, 2, (int32_t) tw[0].h.SampleRate, TW_FLOAT32, TW_SPLIT, output_path) == 0) {
+
+    float input[2][CONVOLVE_BLOCK_SIZE];
+    float mono[CONVOLVE_BLOCK_SIZE];
+    float output[2][CONVOLVE_BLOCK_SIZE];
+    float* input_ptrs[2] = {input[0], input[1]};
+    float* output_ptrs[2] = {output[0], output[1]};
+
+    printf("ambisonic order %d: %d sources, %d convolutions per block\r\n",
+        order, num_sources, 2 * bus->numChannels);
+
+    for (uint32_t done = 0; done < frames; ) {
+      int len = (frames - done) < CONVOLVE_BLOCK_SIZE ? (int) (frames - done) : CONVOLVE_BLOCK_SIZE;
+
+      ambi_bus_begin(bus, len);
+      for (int s = 0; s < num_sources; s++) {
+        int n = tinywav_read_f(&tw[s], input_ptrs, len);
+        if (n <= 0) {
+          continue; // this source has ended
+        }
+        // downmix to mono, a finished source contributes silence for the rest of the block
+        for (int i = 0; i < len; i++) {
+          mono[i] = (i >= n) ? 0.0f
+                  : (tw[s].numChannels == 2) ? 0.5f * (input[0][i] + input[1][i]) : input[0][i];
+        }
+        ambi_encode(bus, mono, azimuths[s], len);
+      }
+      ambi_decode_binaural(bus, output_ptrs, len);
+
+      tinywav_write_f(&tw_out, output_ptrs, len);
+      done += len;
+    }
+
+    tinywav_close_write(&tw_out);
+    res = 0;
+  }
+
+  for (int s = 0; s < opened; s++) {
+    tinywav_close_read(&tw[s]);
+  }
+  free(tw);
+  free(bus);
+  return res;
+}
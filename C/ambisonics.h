@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _AMBISONICS_
+#define _AMBISONICS_
+
+#include <stdint.h>
+#include "tinywav.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Ambisonic bus for rendering many sources at once. Each source is encoded into the
+// bus with a handful of gains, and the bus is decoded binaurally with one convolution
+// per ambisonic channel and ear, so the convolution cost does not grow with the source count.
+//
+// The virtual speakers are the 12 directions of dataset_bin, which all lie on the
+// horizontal plane, so the bus is horizontal-only (circular harmonics):
+// order N carries 2N + 1 channels [1, cos(a), sin(a), cos(2a), sin(2a), ...].
+
+#define AMBI_MAX_ORDER 3
+#define AMBI_MAX_CHANNELS (2 * AMBI_MAX_ORDER + 1)
+#define AMBI_NUM_SPEAKERS 12   // virtual speakers every 30 degrees
+
+typedef struct AmbiBus {
+  int order;        ///< 1 (fastest) to AMBI_MAX_ORDER (sharpest localisation)
+  int numChannels;  ///< 2 * order + 1
+  /// decoder matrix folded into the speaker HRIRs: one filter per ear and ambisonic channel
+  float decoder[2][AMBI_MAX_CHANNELS][FILTER_SIZE];
+  /// per channel: FILTER_SIZE - 1 samples of history followed by the current block
+  float bus[AMBI_MAX_CHANNELS][(FILTER_SIZE - 1) + CONVOLVE_BLOCK_SIZE];
+  /// decode scratch, one channel convolved for one ear; kept here so buses decode concurrently
+  float convolved[(FILTER_SIZE - 1) + CONVOLVE_BLOCK_SIZE];
+} AmbiBus;
+
+/**
+ * Prepare a bus and build its binaural decoder from the virtual speaker filters.
+ *
+ * @param order        The ambisonic order (1 to AMBI_MAX_ORDER), trading quality for throughput.
+ *                     The decode costs 2 * (2 * order + 1) convolutions per block.
+ * @param dataset_dir  Directory holding <deg>_degrees.bin for deg = 0, 30, ..., 330.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int ambi_bus_init(AmbiBus *bus, int order, const char *dataset_dir);
+
+/** Silence the current block of the bus before encoding sources into it. */
+void ambi_bus_begin(AmbiBus *bus, int len);
+
+/**
+ * Mix a mono source into the current block of the bus.
+ *
+ * @param mono     len samples of the source.
+ * @param azimuth  Source direction in degrees.
+ */
+void ambi_encode(AmbiBus *bus, const float *mono, float azimuth, int len);
+
+/**
+ * Decode the current block of the bus to binaural and advance the history.
+ *
+ * @param out  Pointers to the left and right output buffers of at least len samples.
+ */
+void ambi_decode_binaural(AmbiBus *bus, float **out, int len);
+
+/**
+ * The filter pair a single source at azimuth is rendered with through this bus: the
+ * decoder filters weighted by the source's encoding gains. Rendering a mono source
+ * through it with binaural_render() matches encoding and decoding it on the bus.
+ */
+void ambi_bus_filter(const AmbiBus *bus, float azimuth, BinauralFilter *filter);
+
+/**
+ * Render many sources into one binaural file through an ambisonic bus.
+ * Each input is downmixed to mono. The output is as long as the longest input.
+ * All inputs must share one sample rate.
+ *
+ * @param num_sources  Number of input files.
+ * @param audio_files  Paths of the 1 or 2 channel wav inputs.
+ * @param azimuths     Direction of each source in degrees.
+ * @param order        The ambisonic order, see ambi_bus_init().
+ * @param output_path  The path of the binaural output.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_compute_ambisonic(int num_sources, char** audio_files, const float* azimuths,
+    int order, const char* output_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AMBISONICS_
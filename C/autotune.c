@@ -0,0 +1,241 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "autotune.h"
+#include "fft_conv.h"
+#include "conv_kernels.h"
+
+#define AUTOTUNE_FRAMES 65536        // frames of noise rendered per measurement
+#define AUTOTUNE_MIN_SECONDS 0.05    // repeat a measurement until it took at least this long
+#define AUTOTUNE_MIN_BLOCK 64
+#define WISDOM_MAX_ENTRIES 256
+
+typedef struct WisdomEntry {
+  uint32_t taps;
+  uint32_t maxLatency;
+  BinauralKernel kernel;
+  uint32_t blockSize;
+  uint32_t fftSize;
+  double nsPerFrame;
+} WisdomEntry;
+
+static const char* kernel_name(BinauralKernel kernel) {
+  return kernel == BINAURAL_KERNEL_FFT ? "fft" : "direct";
+}
+
+/** @returns the number of entries read, 0 if the file does not exist */
+static int wisdom_read(const char* path, WisdomEntry* entries, int max) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return 0;
+  }
+  int count = 0;
+  char line[256];
+  while (count < max && fgets(line, sizeof(line), f) != NULL) {
+    WisdomEntry* e = &entries[count];
+    char kernel[16];
+    if (line[0] == '#' || sscanf(line, "%u %u %15s %u %u %lf",
+        &e->taps, &e->maxLatency, kernel, &e->blockSize, &e->fftSize, &e->nsPerFrame) != 6) {
+      continue;
+    }
+    e->kernel = strcmp(kernel, "fft") == 0 ? BINAURAL_KERNEL_FFT : BINAURAL_KERNEL_DIRECT;
+    count++;
+  }
+  fclose(f);
+  return count;
+}
+
+static int wisdom_write(const char* path, const WisdomEntry* entries, int count) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    perror("[autotune] Failed to write wisdom");
+    return -1;
+  }
+  fprintf(f, "# taps max_latency kernel block_size fft_size ns_per_frame\n");
+  for (int i = 0; i < count; i++) {
+    const WisdomEntry* e = &entries[i];
+    fprintf(f, "%u %u %s %u %u %.3f\n", e->taps, e->maxLatency, kernel_name(e->kernel),
+        e->blockSize, e->fftSize, e->nsPerFrame);
+  }
+  fclose(f);
+  return 0;
+}
+
+/**
+ * Time rendering AUTOTUNE_FRAMES frames of both channels in blocks of block_size.
+ * audio and out hold FILTER_SIZE - 1 frames of history followed by AUTOTUNE_FRAMES frames.
+ *
+ * @returns nanoseconds per frame, or a negative value on error
+ */
+static double autotune_measure(BinauralFilter* filter, BinauralKernel kernel, uint32_t block_size,
+    uint32_t fft_size, float** audio, float** out) {
+
+  FftConv fc;
+  if (kernel == BINAURAL_KERNEL_FFT && fft_conv_init(&fc, fft_size, filter) != 0) {
+    return -1;
+  }
+
+  long reps = 0;
+  double seconds = 0;
+  clock_t begin = clock();
+  do {
+    for (uint32_t pos = 0; pos < AUTOTUNE_FRAMES; pos += block_size) {
+      uint32_t len = AUTOTUNE_FRAMES - pos < block_size ? AUTOTUNE_FRAMES - pos : block_size;
+      float* audio_block[2] = {audio[0] + pos, audio[1] + pos};
+      float* out_block[2] = {out[0] + pos, out[1] + pos};
+      if (kernel == BINAURAL_KERNEL_FFT) {
+        fft_conv_process(&fc, audio_block, out_block, len);
+      } else {
+        for (int c = 0; c < 2; c++) {
+          conv_dispatch(filter->taps[c], filter->len[c], filter->delay[c],
+              audio_block[c], out_block[c], FILTER_SIZE - 1, len);
+        }
+      }
+    }
+    reps++;
+    seconds = (double) (clock() - begin) / CLOCKS_PER_SEC;
+  } while (seconds < AUTOTUNE_MIN_SECONDS);
+
+  if (kernel == BINAURAL_KERNEL_FFT) {
+    fft_conv_free(&fc);
+  }
+  return seconds * 1e9 / ((double) reps * AUTOTUNE_FRAMES);
+}
+
+/** Free the trial buffers, any of which may be NULL */
+static void autotune_free(float** audio, float** out) {
+  for (int c = 0; c < 2; c++) {
+    free(audio[c]);
+    free(out[c]);
+  }
+}
+
+int binaural_autotune(uint32_t taps, uint32_t max_latency, const char* wisdom_path) {
+
+  if (taps < 1 || taps > FILTER_SIZE || max_latency < 1 || wisdom_path == NULL) {
+    return -1;
+  }
+  if (max_latency > MAX_CONVOLVE_BLOCK_SIZE) {
+    max_latency = MAX_CONVOLVE_BLOCK_SIZE;
+  }
+
+  // noise filter and input; the values don't matter, only the amount of work
+  static BinauralFilter filter;
+  for (int c = 0; c < 2; c++) {
+    filter.len[c] = taps;
+    filter.delay[c] = 0;
+    for (uint32_t j = 0; j < FILTER_SIZE; j++) {
+      filter.taps[c][j] = j < taps ? (float) rand() / RAND_MAX - 0.5f : 0.0f;
+    }
+  }
+  float* audio[2] = {NULL, NULL};
+  float* out[2] = {NULL, NULL};
+  bool ready = true;
+  for (int c = 0; c < 2; c++) {
+    audio[c] = (float *) malloc((FILTER_SIZE - 1 + AUTOTUNE_FRAMES) * sizeof(float));
+    out[c] = (float *) malloc((FILTER_SIZE - 1 + AUTOTUNE_FRAMES) * sizeof(float));
+    ready = ready && audio[c] != NULL && out[c] != NULL;
+  }
+  if (!ready) {
+    autotune_free(audio, out);
+    return -1;
+  }
+  for (int c = 0; c < 2; c++) {
+    for (uint32_t i = 0; i < FILTER_SIZE - 1 + AUTOTUNE_FRAMES; i++) {
+      audio[c][i] = (float) rand() / RAND_MAX - 0.5f;
+    }
+  }
+
+  WisdomEntry best = {taps, max_latency, BINAURAL_KERNEL_DIRECT, 0, 0, 0};
+  uint32_t smallest = max_latency < AUTOTUNE_MIN_BLOCK ? max_latency : AUTOTUNE_MIN_BLOCK;
+  for (uint32_t block = smallest; block <= max_latency; block *= 2) {
+    // the direct kernel, then the smallest FFT that fits the block and the next size up
+    uint32_t fft_min = fft_conv_min_size(block);
+    uint32_t fft_sizes[3] = {0, fft_min, 2 * fft_min};
+    for (int candidate = 0; candidate < 3; candidate++) {
+      BinauralKernel kernel = candidate == 0 ? BINAURAL_KERNEL_DIRECT : BINAURAL_KERNEL_FFT;
+      double ns = autotune_measure(&filter, kernel, block, fft_sizes[candidate], audio, out);
+      if (ns < 0) {
+        continue;
+      }
+      printf("[autotune] taps %u block %4u %-6s fft %5u: %8.2f ns/frame\r\n",
+          taps, block, kernel_name(kernel), fft_sizes[candidate], ns);
+      if (best.blockSize == 0 || ns < best.nsPerFrame) {
+        best.kernel = kernel;
+        best.blockSize = block;
+        best.fftSize = fft_sizes[candidate];
+        best.nsPerFrame = ns;
+      }
+    }
+  }
+
+  autotune_free(audio, out);
+
+  printf("[autotune] fastest: %s, block %u, fft %u (%.2f ns/frame)\r\n",
+      kernel_name(best.kernel), best.blockSize, best.fftSize, best.nsPerFrame);
+
+  // replace any earlier result for the same filter length and budget
+  static WisdomEntry entries[WISDOM_MAX_ENTRIES];
+  int count = wisdom_read(wisdom_path, entries, WISDOM_MAX_ENTRIES - 1);
+  int kept = 0;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].taps != taps || entries[i].maxLatency != max_latency) {
+      entries[kept++] = entries[i];
+    }
+  }
+  entries[kept++] = best;
+  return wisdom_write(wisdom_path, entries, kept);
+}
+
+int binaural_wisdom_apply(BinauralOptions* options, uint32_t taps) {
+
+  if (options == NULL || options->wisdomPath == NULL) {
+    return -1;
+  }
+
+  WisdomEntry entries[WISDOM_MAX_ENTRIES]; // on the stack, renders may apply wisdom concurrently
+  int count = wisdom_read(options->wisdomPath, entries, WISDOM_MAX_ENTRIES);
+
+  // only trust results measured for filters at least as long as this one,
+  // and among those the closest length
+  uint32_t bucket = 0;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].taps >= taps && (bucket == 0 || entries[i].taps < bucket)) {
+      bucket = entries[i].taps;
+    }
+  }
+
+  const WisdomEntry* best = NULL;
+  for (int i = 0; i < count; i++) {
+    const WisdomEntry* e = &entries[i];
+    if (e->taps == bucket && e->blockSize >= 1 && e->blockSize <= options->maxLatency
+        && e->blockSize <= MAX_CONVOLVE_BLOCK_SIZE && (best == NULL || e->nsPerFrame < best->nsPerFrame)) {
+      best = e;
+    }
+  }
+  if (best == NULL) {
+    return -1;
+  }
+
+  options->kernel = best->kernel;
+  options->blockSize = best->blockSize;
+  options->fftSize = best->fftSize;
+  return 0;
+}
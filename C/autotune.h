@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _AUTOTUNE_
+#define _AUTOTUNE_
+
+#include <stdint.h>
+#include "tinywav.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Wisdom is a text file with one tuned configuration per line:
+//
+//   <taps> <max latency> <direct|fft> <block size> <fft size> <ns per frame>
+//
+// meaning that for filters of up to <taps> taps (delay included) and blocks of at most
+// <max latency> frames, the given backend was the fastest measured on this machine.
+
+#define BINAURAL_WISDOM_FILE "binaural_wisdom.txt"
+
+/**
+ * Benchmark every block size, kernel and FFT size within the latency budget on this machine
+ * and store the fastest in the wisdom file, replacing an earlier result for the same
+ * filter length and budget.
+ *
+ * @param taps         The filter length to tune for (delay included), at most FILTER_SIZE.
+ * @param max_latency  The largest block size in frames that may be picked.
+ * @param wisdom_path  The wisdom file to update.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_autotune(uint32_t taps, uint32_t max_latency, const char* wisdom_path);
+
+/**
+ * Look up the fastest tuned configuration for a filter of the given length whose block
+ * size fits options->maxLatency, and apply it to options.
+ *
+ * @return  Zero if a configuration was applied, -1 if the wisdom holds none (options unchanged).
+ */
+int binaural_wisdom_apply(BinauralOptions* options, uint32_t taps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AUTOTUNE_
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Send one request to the render daemon (binaural_daemon.c) and print its reply.
+//
+// Build: gcc binaural_client.c
+// Usage: ./a.out <socket path> RENDER <input|shm:name> <degrees|azimuth:elevation> <output> [<start> <end>]
+//                [format=float32|int16|flac24] [kernel=direct|fft|q15] [threads=<n>]
+//        ./a.out <socket path> PING | SHUTDOWN
+// Exits with 0 if the daemon replied OK.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf("usage: %s <socket path> <command> [arguments...]\r\n", argv[0]);
+    return 2;
+  }
+
+  char request[4096] = "";
+  for (int i = 2; i < argc; i++) {
+    if (strlen(request) + strlen(argv[i]) + 2 > sizeof(request)) {
+      printf("[client] Request too long\r\n");
+      return 2;
+    }
+    strcat(request, argv[i]);
+    strcat(request, i == argc - 1 ? "\n" : " ");
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    perror("[client] Failed to connect");
+    return 1;
+  }
+  if (write(fd, request, strlen(request)) < 0) {
+    perror("[client] Failed to send");
+    close(fd);
+    return 1;
+  }
+  shutdown(fd, SHUT_WR); // one request per invocation
+
+  char reply[1024];
+  ssize_t n = 0, got;
+  while (n < (ssize_t) sizeof(reply) - 1 && (got = read(fd, reply + n, sizeof(reply) - 1 - n)) > 0) {
+    n += got;
+  }
+  close(fd);
+  reply[n > 0 ? n : 0] = '\0';
+  fputs(reply, stdout);
+  return strncmp(reply, "OK", 2) == 0 ? 0 : 1;
+}
@@ -0,0 +1,651 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Resident render daemon. Loads the filters (and optionally a compiled HRIR database),
+// applies the autotune wisdom and prepares FFT plans once, then serves render jobs from a
+// pool of workers over a Unix domain socket, so a job costs only its convolution.
+//
+// Build (POSIX only):
+//   gcc -DTINYWAV_NO_MAIN binaural_daemon.c tinywav.c hrir_db.c fft_conv.c autotune.c conv_kernels.c render_cache.c ring_buffer.c flac_writer.c fixed_conv.c -lm -lpthread -lrt
+// Run from the directory holding dataset_bin:
+//   ./a.out [socket path] [workers] [database.hrdb]
+//
+// Protocol, one request per line, one reply line per request:
+//   RENDER <input> <direction> <output> [<start frame> <end frame>] [<option>=<value> ...]
+//                                         input is a wav path, or shm:<name> for a wav held in a
+//                                         POSIX shared memory object (shm_open); direction is
+//                                         degrees on the horizontal plane (snapped to 30), or
+//                                         <azimuth>:<elevation> to interpolate from the database;
+//                                         the optional range renders only those input frames,
+//                                         start before end.
+//                                         Options, as the BinauralOptions of the same name:
+//                                           format=float32|int16|flac24   (default float32)
+//                                           kernel=direct|fft|q15         (default from the wisdom)
+//                                           threads=<encoder threads>     (default 1)
+//     -> OK frames=<frames> ms=<render time>
+//   PING      -> OK
+//   SHUTDOWN  -> OK, then the daemon stops accepting jobs and exits; only accepted from
+//                clients running as the daemon's own user
+//   any error -> ERR <reason>
+//
+// The listening thread receives the requests and hands a connection to a worker only once a
+// whole request line has arrived on it; the connection goes back to the listening thread after
+// each request, so idle or slowly sending clients hold no worker and requests of several
+// clients interleave.
+
+#define _GNU_SOURCE // for struct ucred
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "tinywav.h"
+#include "hrir_db.h"
+#include "fft_conv.h"
+#include "autotune.h"
+
+#define DAEMON_SOCKET_PATH "/tmp/binaural.sock"
+#define DAEMON_WORKERS 4
+#define DAEMON_MAX_WORKERS 64
+#define DAEMON_MAX_CONNECTIONS 256 // open client connections; more are turned away
+#define DAEMON_SEND_TIMEOUT 2      // seconds a worker waits for a client to take its reply
+#define DAEMON_NUM_ANGLES 12       // dataset_bin holds 0, 30, ..., 330 degrees
+#define DAEMON_LINE_SIZE 1024
+#define DAEMON_MAX_TOKENS 12
+
+typedef struct DaemonAngle {
+  BinauralFilter filter;
+  BinauralOptions options; ///< wisdom already applied, never re-read per job
+} DaemonAngle;
+
+typedef struct DaemonWorker {
+  pthread_t thread;
+  FftConv plans[DAEMON_NUM_ANGLES]; ///< FFT plans are not shareable, they hold work buffers
+  bool hasPlan[DAEMON_NUM_ANGLES];
+} DaemonWorker;
+
+static DaemonAngle angles[DAEMON_NUM_ANGLES];
+static HrirDb db;
+static BinauralOptions db_options;
+
+typedef struct DaemonConnection {
+  int fd;
+  bool owner;                   ///< the client runs as the daemon's user
+  uint32_t len;                 ///< bytes received but not yet served, received by the listening thread only
+  char buffer[DAEMON_LINE_SIZE];
+} DaemonConnection;
+
+// connections with a request to serve, taken by the workers
+static DaemonConnection* queue[DAEMON_MAX_CONNECTIONS];
+static int queue_head = 0;
+static int queue_count = 0;
+// served connections handed back to the listening thread, to wait for their next request
+static DaemonConnection* returned[DAEMON_MAX_CONNECTIONS];
+static int returned_count = 0;
+static int open_connections = 0;
+static bool stopping = false;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static int listen_fd = -1;
+static int wake_fds[2] = {-1, -1}; ///< written to wake the listening thread from poll()
+
+static double elapsed_ms(const struct timespec* begin) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - begin->tv_sec) * 1e3 + (now.tv_nsec - begin->tv_nsec) / 1e6;
+}
+
+/** Resolve block size and kernel for this filter once, so jobs don't touch the wisdom file */
+static void daemon_tune(BinauralOptions* options, const BinauralFilter* filter) {
+  BinauralOptions defaults;
+  binaural_options_default(&defaults);
+  defaults.progress = false;
+  binaural_options_resolve(&defaults, filter, options);
+}
+
+static int daemon_load(const char* db_path) {
+  for (int a = 0; a < DAEMON_NUM_ANGLES; a++) {
+    if (binaural_load_filter(a * 30, &angles[a].filter) != 0) {
+      return -1;
+    }
+    daemon_tune(&angles[a].options, &angles[a].filter);
+  }
+  if (db_path != NULL) {
+    if (hrir_db_open(&db, db_path) != 0) {
+      return -1;
+    }
+    if (db.h.NumChannels != 2) {
+      printf("[daemon] %s has %u channels, expected 2\r\n", db_path, db.h.NumChannels);
+      return -1;
+    }
+    // interpolated filters all have the database's length, one tuning covers them
+    BinauralFilter full = {0};
+    full.len[0] = full.len[1] = db.h.FilterSize < FILTER_SIZE ? db.h.FilterSize : FILTER_SIZE;
+    daemon_tune(&db_options, &full);
+  }
+  return 0;
+}
+
+static void daemon_prepare(DaemonWorker* worker) {
+  for (int a = 0; a < DAEMON_NUM_ANGLES; a++) {
+    const BinauralOptions* o = &angles[a].options;
+    worker->hasPlan[a] = false;
+    if (o->kernel == BINAURAL_KERNEL_FFT) {
+      worker->hasPlan[a] = fft_conv_init(&worker->plans[a], o->fftSize, &angles[a].filter) == 0;
+    }
+  }
+}
+
+/** Open shm:<name> as a wav stream over a read-only mapping of the shared memory object */
+static int daemon_open_shm(TinyWav* tw, const char* name, void** map, size_t* map_size) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return -1;
+  }
+  *map_size = (size_t) st.st_size;
+  *map = mmap(NULL, *map_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (*map == MAP_FAILED) {
+    *map = NULL;
+    return -1;
+  }
+  FILE* f = fmemopen(*map, *map_size, "rb");
+  if (f == NULL || tinywav_open_read_stream(tw, f, TW_SPLIT) != 0) {
+    munmap(*map, *map_size);
+    *map = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+typedef struct DaemonRequest {
+  const char* input;
+  const char* direction;
+  const char* output;
+  uint32_t start;
+  uint32_t end;
+  TinyWavSampleFormat format;
+  int kernel;        ///< a BinauralKernel, or -1 for the one the wisdom picked
+  uint32_t threads;  ///< FLAC encoder threads
+} DaemonRequest;
+
+/** Run one RENDER job; writes the reply into reply */
+static void daemon_render(DaemonWorker* worker, const DaemonRequest* request, char* reply, size_t reply_size) {
+
+  const char* input = request->input;
+  const char* direction = request->direction;
+  const char* output = request->output;
+
+  // resolve the filter: a preloaded angle, or an interpolation from the database
+  BinauralFilter interpolated = {0};
+  BinauralFilter* filter;
+  BinauralOptions options;
+  FftConv* plan = NULL;
+  float azimuth, elevation;
+  if (strchr(direction, ':') != NULL) {
+    if (!hrir_db_isOpen(&db)) {
+      snprintf(reply, reply_size, "ERR no database loaded\n");
+      return;
+    }
+    if (sscanf(direction, "%f:%f", &azimuth, &elevation) != 2) {
+      snprintf(reply, reply_size, "ERR bad direction %s\n", direction);
+      return;
+    }
+    float* taps[2];
+    for (int c = 0; c < 2; c++) {
+      taps[c] = (float *) malloc(db.h.FilterSize * sizeof(float));
+    }
+    int res = (taps[0] == NULL || taps[1] == NULL) ? -1 : hrir_db_interpolate(&db, azimuth, elevation, taps);
+    uint32_t len = db.h.FilterSize < FILTER_SIZE ? db.h.FilterSize : FILTER_SIZE;
+    for (int c = 0; c < 2; c++) {
+      if (res == 0) {
+        copy_array_f(interpolated.taps[c], taps[c], 0, 0, len);
+      }
+      interpolated.len[c] = len;
+      interpolated.delay[c] = 0;
+      free(taps[c]);
+    }
+    if (res != 0) {
+      snprintf(reply, reply_size, "ERR cannot interpolate %s\n", direction);
+      return;
+    }
+    filter = &interpolated;
+    options = db_options;
+  } else {
+    char* end;
+    long degrees = strtol(direction, &end, 10);
+    if (*end != '\0') {
+      snprintf(reply, reply_size, "ERR bad direction %s\n", direction);
+      return;
+    }
+    int a = (int) (((lround(degrees / 30.0) % DAEMON_NUM_ANGLES) + DAEMON_NUM_ANGLES) % DAEMON_NUM_ANGLES);
+    filter = &angles[a].filter;
+    options = angles[a].options;
+    plan = worker->hasPlan[a] ? &worker->plans[a] : NULL;
+  }
+
+  TinyWav tw;
+  void* map = NULL;
+  size_t map_size = 0;
+  int opened = strncmp(input, "shm:", 4) == 0
+             ? daemon_open_shm(&tw, input + 4, &map, &map_size)
+             : tinywav_open_read(&tw, input, TW_SPLIT);
+  if (opened != 0) {
+    snprintf(reply, reply_size, "ERR cannot read %s\n", input);
+    return;
+  }
+  if (tw.numChannels > 2) {
+    snprintf(reply, reply_size, "ERR %s has %d channels, expected 1 or 2\n", input, tw.numChannels);
+  } else {
+    options.startFrame = request->start;
+    options.endFrame = request->end;
+    options.outputFormat = request->format;
+    options.encoderThreads = request->threads;
+    if (request->kernel >= 0) {
+      options.kernel = (BinauralKernel) request->kernel; // the FFT size is fitted by the render
+    }
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    uint32_t frames = 0;
+    int res = binaural_render_to(&tw, output, filter, &options, plan, &frames);
+    double ms = elapsed_ms(&begin);
+    if (res != 0) {
+      snprintf(reply, reply_size, "ERR cannot render %s to %s\n", input, output);
+    } else {
+      snprintf(reply, reply_size, "OK frames=%u ms=%.3f\n", frames, ms);
+    }
+  }
+  tinywav_close_read(&tw);
+  if (map != NULL) {
+    munmap(map, map_size);
+  }
+}
+
+/** Wake the listening thread out of poll() */
+static void daemon_wake(void) {
+  char byte = 0;
+  if (write(wake_fds[1], &byte, 1) < 0) {
+    // the pipe is full, the listening thread is due to wake anyway
+  }
+}
+
+static void daemon_stop(void) {
+  pthread_mutex_lock(&queue_lock);
+  stopping = true;
+  pthread_cond_broadcast(&queue_ready);
+  pthread_mutex_unlock(&queue_lock);
+  daemon_wake();
+}
+
+/** @returns true if the peer of a connection runs as the same user as the daemon */
+static bool daemon_peer_is_owner(int fd) {
+#if defined(SO_PEERCRED)
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+/** @returns the length of the first complete line buffered on the connection, newline included, or 0 */
+static uint32_t daemon_buffered_line(const DaemonConnection* conn) {
+  const char* newline = (const char *) memchr(conn->buffer, '\n', conn->len);
+  return newline != NULL ? (uint32_t) (newline - conn->buffer) + 1 : 0;
+}
+
+/**
+ * Receive what has arrived on a connection without blocking; called by the listening thread when
+ * poll() reports the connection readable.
+ *
+ * @return  Zero if the connection stays open, -1 if the client hung up or sent an overlong line.
+ */
+static int daemon_receive(DaemonConnection* conn) {
+  ssize_t got = recv(conn->fd, conn->buffer + conn->len, sizeof(conn->buffer) - conn->len, MSG_DONTWAIT);
+  if (got < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+  }
+  if (got == 0) {
+    return -1;
+  }
+  conn->len += (uint32_t) got;
+  return daemon_buffered_line(conn) == 0 && conn->len == sizeof(conn->buffer) ? -1 : 0;
+}
+
+/** Take the first request line off a connection, which must have one buffered */
+static void daemon_next_line(DaemonConnection* conn, char* line) {
+  uint32_t len = daemon_buffered_line(conn);
+  memcpy(line, conn->buffer, len - 1);
+  line[len - 1] = '\0';
+  conn->len -= len;
+  memmove(conn->buffer, conn->buffer + len, conn->len);
+}
+
+/** Parse and run one request line; writes the reply into reply. @returns true for SHUTDOWN */
+static bool daemon_request(DaemonWorker* worker, const DaemonConnection* conn, char* line, char* reply, size_t reply_size) {
+  char* tokens[DAEMON_MAX_TOKENS];
+  int count = 0;
+  char* save = NULL;
+  for (char* t = strtok_r(line, " \t\r", &save); t != NULL && count < DAEMON_MAX_TOKENS; t = strtok_r(NULL, " \t\r", &save)) {
+    tokens[count++] = t;
+  }
+
+  if (count >= 1 && strcmp(tokens[0], "PING") == 0) {
+    snprintf(reply, reply_size, "OK\n");
+    return false;
+  }
+  if (count >= 1 && strcmp(tokens[0], "SHUTDOWN") == 0) {
+    if (!conn->owner) {
+      snprintf(reply, reply_size, "ERR SHUTDOWN is only accepted from the daemon's user\n");
+      return false;
+    }
+    snprintf(reply, reply_size, "OK\n");
+    return true;
+  }
+
+  DaemonRequest request = {NULL, NULL, NULL, 0, UINT32_MAX, TW_FLOAT32, -1, 1};
+  bool valid = count >= 4 && strcmp(tokens[0], "RENDER") == 0;
+  int next = 4;
+  if (valid && count >= 6 && strchr(tokens[4], '=') == NULL) {
+    char* end_start;
+    char* end_end;
+    request.start = (uint32_t) strtoul(tokens[4], &end_start, 10);
+    request.end = (uint32_t) strtoul(tokens[5], &end_end, 10);
+    valid = *end_start == '\0' && *end_end == '\0' && request.start < request.end;
+    next = 6;
+  }
+  for (int i = next; valid && i < count; i++) {
+    const char* value = strchr(tokens[i], '=');
+    valid = value != NULL;
+    if (!valid) {
+      break;
+    }
+    value++;
+    if (strncmp(tokens[i], "format=", 7) == 0) {
+      valid = strcmp(value, "float32") == 0 || strcmp(value, "int16") == 0 || strcmp(value, "flac24") == 0;
+      request.format = strcmp(value, "int16") == 0 ? TW_INT16 : strcmp(value, "flac24") == 0 ? TW_FLAC24 : TW_FLOAT32;
+    } else if (strncmp(tokens[i], "kernel=", 7) == 0) {
+      valid = strcmp(value, "direct") == 0 || strcmp(value, "fft") == 0 || strcmp(value, "q15") == 0;
+      request.kernel = strcmp(value, "fft") == 0 ? BINAURAL_KERNEL_FFT
+                     : strcmp(value, "q15") == 0 ? BINAURAL_KERNEL_Q15 : BINAURAL_KERNEL_DIRECT;
+    } else if (strncmp(tokens[i], "threads=", 8) == 0) {
+      int threads = atoi(value);
+      valid = threads >= 1;
+      request.threads = (uint32_t) threads;
+    } else {
+      valid = false;
+    }
+  }
+  if (!valid) {
+    snprintf(reply, reply_size, "ERR usage: RENDER <input|shm:name> <degrees|azimuth:elevation> <output> [<start> <end>]"
+        " [format=float32|int16|flac24] [kernel=direct|fft|q15] [threads=<n>]\n");
+    return false;
+  }
+  request.input = tokens[1];
+  request.direction = tokens[2];
+  request.output = tokens[3];
+  daemon_render(worker, &request, reply, reply_size);
+  return false;
+}
+
+/** Close a connection for good */
+static void daemon_close(DaemonConnection* conn) {
+  close(conn->fd);
+  free(conn);
+  pthread_mutex_lock(&queue_lock);
+  open_connections--;
+  pthread_mutex_unlock(&queue_lock);
+}
+
+/** Queue a connection with a request for the workers; called with queue_lock held */
+static void daemon_enqueue(DaemonConnection* conn) {
+  queue[(queue_head + queue_count) % DAEMON_MAX_CONNECTIONS] = conn;
+  queue_count++;
+  pthread_cond_signal(&queue_ready);
+}
+
+/** Serve one request of a connection, then queue it again or hand it back to the listening thread */
+static void daemon_serve(DaemonWorker* worker, DaemonConnection* conn) {
+  char line[DAEMON_LINE_SIZE];
+  char reply[DAEMON_LINE_SIZE + 256];
+  daemon_next_line(conn, line);
+  bool quit = daemon_request(worker, conn, line, reply, sizeof(reply));
+  if (send(conn->fd, reply, strlen(reply), 0) < 0) {
+    daemon_close(conn);
+    return;
+  }
+  if (quit) {
+    daemon_close(conn);
+    daemon_stop();
+    return;
+  }
+
+  pthread_mutex_lock(&queue_lock);
+  if (daemon_buffered_line(conn) > 0) {
+    daemon_enqueue(conn); // pipelined requests wait behind the other clients' ones
+  } else {
+    returned[returned_count++] = conn;
+  }
+  pthread_mutex_unlock(&queue_lock);
+  daemon_wake();
+}
+
+static void* daemon_worker(void* arg) {
+  DaemonWorker* worker = (DaemonWorker *) arg;
+  for (;;) {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_count == 0 && !stopping) {
+      pthread_cond_wait(&queue_ready, &queue_lock);
+    }
+    if (stopping) {
+      pthread_mutex_unlock(&queue_lock);
+      return NULL;
+    }
+    DaemonConnection* conn = queue[queue_head];
+    queue_head = (queue_head + 1) % DAEMON_MAX_CONNECTIONS;
+    queue_count--;
+    pthread_mutex_unlock(&queue_lock);
+
+    daemon_serve(worker, conn);
+  }
+}
+
+/** Accept a client, or turn it away when DAEMON_MAX_CONNECTIONS are open. @returns the connection or NULL */
+static DaemonConnection* daemon_accept(void) {
+  int fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0) {
+    return NULL;
+  }
+  pthread_mutex_lock(&queue_lock);
+  bool full = open_connections == DAEMON_MAX_CONNECTIONS;
+  open_connections += full ? 0 : 1;
+  pthread_mutex_unlock(&queue_lock);
+  DaemonConnection* conn = full ? NULL : (DaemonConnection *) malloc(sizeof(DaemonConnection));
+  if (conn == NULL) {
+    const char* busy = "ERR too many connections\n";
+    if (send(fd, busy, strlen(busy), 0) < 0) {
+      // the client is gone already
+    }
+    close(fd);
+    if (!full) {
+      pthread_mutex_lock(&queue_lock);
+      open_connections--;
+      pthread_mutex_unlock(&queue_lock);
+    }
+    return NULL;
+  }
+  // a worker only waits this long for a client that does not read its replies
+  struct timeval timeout = {DAEMON_SEND_TIMEOUT, 0};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  conn->fd = fd;
+  conn->owner = daemon_peer_is_owner(fd);
+  conn->len = 0;
+  return conn;
+}
+
+int main(int argc, char** argv) {
+  const char* socket_path = argc > 1 ? argv[1] : DAEMON_SOCKET_PATH;
+  int num_workers = argc > 2 ? atoi(argv[2]) : DAEMON_WORKERS;
+  const char* db_path = argc > 3 ? argv[3] : NULL;
+  if (num_workers < 1 || num_workers > DAEMON_MAX_WORKERS) {
+    num_workers = DAEMON_WORKERS;
+  }
+
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  if (daemon_load(db_path) != 0) {
+    printf("[daemon] Failed to load filters\r\n");
+    return 1;
+  }
+
+  static DaemonWorker workers[DAEMON_MAX_WORKERS];
+  for (int w = 0; w < num_workers; w++) {
+    daemon_prepare(&workers[w]);
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    printf("[daemon] Socket path too long: %s\r\n", socket_path);
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+  unlink(socket_path); // a stale socket from an earlier run
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+      || listen(listen_fd, SOMAXCONN) != 0 || pipe(wake_fds) != 0) {
+    perror("[daemon] Failed to listen");
+    return 1;
+  }
+  fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+  signal(SIGPIPE, SIG_IGN); // a client hanging up must not kill the daemon
+
+  for (int w = 0; w < num_workers; w++) {
+    pthread_create(&workers[w].thread, NULL, daemon_worker, &workers[w]);
+  }
+  printf("[daemon] %d workers listening on %s (ready in %.1f ms)\r\n", num_workers, socket_path, elapsed_ms(&begin));
+
+  // connections waiting for their next request, watched together with the socket and the wake pipe
+  static DaemonConnection* idle[DAEMON_MAX_CONNECTIONS];
+  static struct pollfd fds[2 + DAEMON_MAX_CONNECTIONS];
+  int idle_count = 0;
+  for (;;) {
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_fds[0];
+    fds[1].events = POLLIN;
+    for (int i = 0; i < idle_count; i++) {
+      fds[2 + i].fd = idle[i]->fd;
+      fds[2 + i].events = POLLIN;
+    }
+    if (poll(fds, 2 + idle_count, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    bool stop = stopping;
+    pthread_mutex_unlock(&queue_lock);
+    if (stop) {
+      break;
+    }
+
+    // receive on the idle connections; once a whole request line is in, a worker takes it from here
+    int kept = 0;
+    for (int i = 0; i < idle_count; i++) {
+      DaemonConnection* conn = idle[i];
+      if (fds[2 + i].revents != 0 && daemon_receive(conn) != 0) {
+        daemon_close(conn);
+      } else if (daemon_buffered_line(conn) > 0) {
+        pthread_mutex_lock(&queue_lock);
+        daemon_enqueue(conn);
+        pthread_mutex_unlock(&queue_lock);
+      } else {
+        idle[kept++] = conn;
+      }
+    }
+    idle_count = kept;
+
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      while (read(wake_fds[0], drain, sizeof(drain)) > 0) {
+      }
+      pthread_mutex_lock(&queue_lock);
+      for (int i = 0; i < returned_count; i++) {
+        idle[idle_count++] = returned[i];
+      }
+      returned_count = 0;
+      pthread_mutex_unlock(&queue_lock);
+    }
+
+    if (fds[0].revents & POLLIN) {
+      DaemonConnection* conn = daemon_accept();
+      if (conn != NULL) {
+        idle[idle_count++] = conn;
+      }
+    }
+  }
+
+  daemon_stop();
+  for (int w = 0; w < num_workers; w++) {
+    pthread_join(workers[w].thread, NULL);
+    for (int a = 0; a < DAEMON_NUM_ANGLES; a++) {
+      if (workers[w].hasPlan[a]) {
+        fft_conv_free(&workers[w].plans[a]);
+      }
+    }
+  }
+  // with the workers gone every open connection is idle, queued or returned
+  for (int i = 0; i < idle_count; i++) {
+    daemon_close(idle[i]);
+  }
+  for (; queue_count > 0; queue_count--, queue_head = (queue_head + 1) % DAEMON_MAX_CONNECTIONS) {
+    daemon_close(queue[queue_head]);
+  }
+  for (int i = 0; i < returned_count; i++) {
+    daemon_close(returned[i]);
+  }
+  close(wake_fds[0]);
+  close(wake_fds[1]);
+  close(listen_fd);
+  unlink(socket_path);
+  if (hrir_db_isOpen(&db)) {
+    hrir_db_close(&db);
+  }
+  printf("[daemon] stopped\r\n");
+  return 0;
+}
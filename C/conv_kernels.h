@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _CONV_KERNELS_
+#define _CONV_KERNELS_
+
+#include <stdint.h>
+#include "tinywav.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Time domain convolution kernels specialised at compile time for the common filter lengths
+// (128, 256 and, when FILTER_SIZE allows it, 512 taps) and block sizes (64 to 4096 frames).
+// With both trip counts constant the tap loop is unrolled 16 times (not by the full tap count,
+// see CONV_UNROLL) and a tile of outputs stays in vector registers. Any other combination runs
+// a generic loop with the same tiling; shorter filters are padded with zero taps to the next
+// specialised length (see conv_dispatch()).
+
+// The kernels and conv_32_delay() sit between CONV_EXACT_BEGIN and CONV_EXACT_END, which keep
+// the compiler from fusing a product and its sum into one multiply-add (as it may with FMA
+// hardware, e.g. -march=native): fused in one loop but not in another, the results differ.
+#if defined(__clang__)
+#define CONV_EXACT_BEGIN _Pragma("clang fp contract(off)")
+#define CONV_EXACT_END
+#elif defined(__GNUC__)
+#define CONV_EXACT_BEGIN _Pragma("GCC push_options") _Pragma("GCC optimize (\"fp-contract=off\")")
+#define CONV_EXACT_END _Pragma("GCC pop_options")
+#else
+#define CONV_EXACT_BEGIN _Pragma("STDC FP_CONTRACT OFF")
+#define CONV_EXACT_END
+#endif
+
+/** Computes output[i] = sum of filter[j] * audio[i - j] for a fixed number of taps and frames */
+typedef void (*conv_kernel_fn)(const float* filter, const float* audio, float* output);
+
+/** @returns the kernel specialised for the given taps and block length, or NULL if there is none */
+conv_kernel_fn conv_kernel_lookup(uint32_t taps, uint32_t len);
+
+/**
+ * Same contract as conv_32_delay(), running the specialised kernel for (taps, len) when
+ * there is one and the generic loop otherwise. A tap count below a specialised one runs that
+ * kernel, so filter must be zero from taps up to FILTER_SIZE - delay (as BinauralFilter is). Both give bit-identical results with any
+ * optimisation and -march setting (not with -ffast-math, which lets the compiler reorder sums).
+ */
+void conv_dispatch(float* filter, uint32_t taps, uint32_t delay, float* audio, float* output, uint32_t start, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CONV_KERNELS_
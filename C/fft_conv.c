@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h> // for memset
+#include <stdlib.h>
+#include <math.h>
+#include "fft_conv.h"
+
+/** In-place iterative radix-2 FFT on split real/imaginary arrays. inverse does not scale. */
+static void fft(const FftConv *fc, float *re, float *im, bool inverse) {
+  uint32_t n = fc->n;
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t j = fc->bitrev[i];
+    if (j > i) {
+      float t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  float sign = inverse ? 1.0f : -1.0f;
+  for (uint32_t size = 2; size <= n; size <<= 1) {
+    uint32_t half = size >> 1;
+    uint32_t step = n / size;
+    for (uint32_t start = 0; start < n; start += size) {
+      for (uint32_t k = 0; k < half; k++) {
+        float wr = fc->cosTable[k * step];
+        float wi = sign * fc->sinTable[k * step];
+        uint32_t a = start + k;
+        uint32_t b = a + half;
+        float tr = re[b] * wr - im[b] * wi;
+        float ti = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+      }
+    }
+  }
+}
+
+uint32_t fft_conv_min_size(uint32_t len) {
+  uint32_t n = 1;
+  while (n < len + FILTER_SIZE - 1) {
+    n <<= 1;
+  }
+  return n;
+}
+
+int fft_conv_init(FftConv *fc, uint32_t n, const BinauralFilter *filter) {
+
+  if (fc == NULL || filter == NULL || n < 2 || (n & (n - 1)) != 0 || n < FILTER_SIZE) {
+    return -1;
+  }
+
+  memset(fc, 0, sizeof(FftConv));
+  fc->n = n;
+  while ((1u << fc->log2n) < n) {
+    fc->log2n++;
+  }
+
+  fc->cosTable = (float *) malloc(n / 2 * sizeof(float));
+  fc->sinTable = (float *) malloc(n / 2 * sizeof(float));
+  fc->bitrev = (uint32_t *) malloc(n * sizeof(uint32_t));
+  fc->re = (float *) malloc(n * sizeof(float));
+  fc->im = (float *) malloc(n * sizeof(float));
+  for (int c = 0; c < 2; c++) {
+    fc->filterRe[c] = (float *) malloc(n * sizeof(float));
+    fc->filterIm[c] = (float *) malloc(n * sizeof(float));
+  }
+  if (!fc->cosTable || !fc->sinTable || !fc->bitrev || !fc->re || !fc->im
+      || !fc->filterRe[0] || !fc->filterIm[0] || !fc->filterRe[1] || !fc->filterIm[1]) {
+    fft_conv_free(fc);
+    return -1;
+  }
+
+  for (uint32_t k = 0; k < n / 2; k++) {
+    double a = 2.0 * 3.14159265358979323846 * k / n;
+    fc->cosTable[k] = (float) cos(a);
+    fc->sinTable[k] = (float) sin(a);
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t r = 0;
+    for (uint32_t b = 0; b < fc->log2n; b++) {
+      r |= ((i >> b) & 1) << (fc->log2n - 1 - b);
+    }
+    fc->bitrev[i] = r;
+  }
+
+  // filter spectra, with the onset delay folded in
+  for (int c = 0; c < 2; c++) {
+    memset(fc->filterRe[c], 0, n * sizeof(float));
+    memset(fc->filterIm[c], 0, n * sizeof(float));
+    for (uint32_t j = 0; j < filter->len[c]; j++) {
+      fc->filterRe[c][filter->delay[c] + j] = filter->taps[c][j];
+    }
+    fft(fc, fc->filterRe[c], fc->filterIm[c], false);
+  }
+
+  return 0;
+}
+
+void fft_conv_free(FftConv *fc) {
+  if (fc == NULL) {
+    return;
+  }
+  free(fc->cosTable);
+  free(fc->sinTable);
+  free(fc->bitrev);
+  free(fc->re);
+  free(fc->im);
+  for (int c = 0; c < 2; c++) {
+    free(fc->filterRe[c]);
+    free(fc->filterIm[c]);
+  }
+  memset(fc, 0, sizeof(FftConv));
+}
+
+void fft_conv_process(FftConv *fc, float **audio, float **output, uint32_t len) {
+
+  uint32_t n = fc->n;
+  uint32_t frame = (FILTER_SIZE - 1) + len; // history + block, zero padded up to n
+  float *re = fc->re;
+  float *im = fc->im;
+
+  for (uint32_t i = 0; i < frame; i++) {
+    re[i] = audio[0][i];
+    im[i] = audio[1][i];
+  }
+  memset(re + frame, 0, (n - frame) * sizeof(float));
+  memset(im + frame, 0, (n - frame) * sizeof(float));
+
+  fft(fc, re, im, false);
+
+  // Z = XL + i XR with XL, XR the spectra of real signals, so
+  // XL[k] = (Z[k] + conj(Z[n-k])) / 2 and XR[k] = (Z[k] - conj(Z[n-k])) / 2i.
+  // Multiply each by its filter and pack them back as Y = YL + i YR.
+  const float *hlr = fc->filterRe[0], *hli = fc->filterIm[0];
+  const float *hrr = fc->filterRe[1], *hri = fc->filterIm[1];
+  for (uint32_t k = 0; k <= n / 2; k++) {
+    uint32_t j = (n - k) & (n - 1);
+    float a = re[k], b = im[k], c = re[j], d = im[j];
+
+    // bin k
+    float xlr = 0.5f * (a + c), xli = 0.5f * (b - d);
+    float xrr = 0.5f * (b + d), xri = -0.5f * (a - c);
+    float ylr = xlr * hlr[k] - xli * hli[k], yli = xlr * hli[k] + xli * hlr[k];
+    float yrr = xrr * hrr[k] - xri * hri[k], yri = xrr * hri[k] + xri * hrr[k];
+    re[k] = ylr - yri;
+    im[k] = yli + yrr;
+
+    if (j != k) {
+      // bin n - k, whose separated spectra are the conjugates of those at bin k
+      ylr = xlr * hlr[j] + xli * hli[j];  yli = xlr * hli[j] - xli * hlr[j];
+      yrr = xrr * hrr[j] + xri * hri[j];  yri = xrr * hri[j] - xri * hrr[j];
+      re[j] = ylr - yri;
+      im[j] = yli + yrr;
+    }
+  }
+
+  fft(fc, re, im, true);
+
+  float scale = 1.0f / n;
+  for (uint32_t i = 0; i < len; i++) {
+    output[0][(FILTER_SIZE - 1) + i] = re[(FILTER_SIZE - 1) + i] * scale;
+    output[1][(FILTER_SIZE - 1) + i] = im[(FILTER_SIZE - 1) + i] * scale;
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FFT_CONV_
+#define _FFT_CONV_
+
+#include <stdint.h>
+#include "tinywav.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Block convolution of both channels in the frequency domain. The left and right inputs are
+// packed into the real and imaginary parts of one complex FFT and separated again by conjugate
+// symmetry, so a block costs one forward and one inverse FFT of size n for both channels.
+
+typedef struct FftConv {
+  uint32_t n;          ///< FFT size, a power of two
+  uint32_t log2n;
+  float *cosTable;     ///< twiddles, n / 2 each
+  float *sinTable;
+  uint32_t *bitrev;
+  float *filterRe[2];  ///< spectra of the (delayed) filters, n each
+  float *filterIm[2];
+  float *re;           ///< work buffers, n each
+  float *im;
+} FftConv;
+
+/**
+ * Prepare the FFT tables and filter spectra.
+ *
+ * @param n       The FFT size. Must be a power of two and at least len + FILTER_SIZE - 1
+ *                for the block lengths later passed to fft_conv_process().
+ * @param filter  The filter pair to convolve with.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int fft_conv_init(FftConv *fc, uint32_t n, const BinauralFilter *filter);
+
+/** Release the buffers. The FftConv struct is now invalid. */
+void fft_conv_free(FftConv *fc);
+
+/**
+ * Same contract as conv_32(): audio[c] holds FILTER_SIZE - 1 samples of history followed by
+ * len new samples, and output[c][FILTER_SIZE - 1 + i] receives sample i of the block.
+ */
+void fft_conv_process(FftConv *fc, float **audio, float **output, uint32_t len);
+
+/** @returns the smallest power of two FFT size able to convolve blocks of len frames */
+uint32_t fft_conv_min_size(uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _FFT_CONV_
@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdlib.h> // for abs
+#include <math.h>
+#include "fixed_conv.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define Q15_MAX_FRAC 30
+
+int binaural_filter_to_q15(const BinauralFilter* filter, BinauralFilterQ15* q15) {
+
+  if (filter == NULL || q15 == NULL) {
+    return -1;
+  }
+
+  memset(q15, 0, sizeof(BinauralFilterQ15));
+  for (int c = 0; c < 2; c++) {
+    uint32_t taps = filter->len[c] < FILTER_SIZE ? filter->len[c] : FILTER_SIZE;
+    q15->len[c] = taps;
+    q15->delay[c] = filter->delay[c];
+
+    // the largest tap sets the exponent
+    float peak = 0.0f;
+    for (uint32_t j = 0; j < taps; j++) {
+      peak = fabsf(filter->taps[c][j]) > peak ? fabsf(filter->taps[c][j]) : peak;
+    }
+    int exponent = 0;
+    frexpf(peak, &exponent); // peak < 2^exponent
+    int frac = peak > 0.0f ? 15 - exponent : 15;
+    frac = frac < 0 ? 0 : frac > Q15_MAX_FRAC ? Q15_MAX_FRAC : frac;
+    q15->frac[c] = (uint32_t) frac;
+
+    for (uint32_t j = 0; j < taps; j++) {
+      long q = lrintf(ldexpf(filter->taps[c][j], frac));
+      q15->taps[c][taps - 1 - j] = (int16_t) (q > INT16_MAX ? INT16_MAX : q < -INT16_MAX ? -INT16_MAX : q);
+    }
+
+    // close a span before any 32-bit lane could overflow; lane p of a group sums taps 2p and 2p + 1
+    uint32_t groups = (taps + Q15_GROUP - 1) / Q15_GROUP;
+    uint32_t lane[Q15_GROUP / 2] = {0};
+    for (uint32_t g = 0; g < groups; g++) {
+      const int16_t* r = q15->taps[c] + g * Q15_GROUP;
+      bool full = false;
+      for (int p = 0; p < Q15_GROUP / 2; p++) {
+        full = full || lane[p] + abs(r[2 * p]) + abs(r[2 * p + 1]) > Q15_LANE_LIMIT;
+      }
+      if (full) {
+        q15->spanEnd[c][q15->spans[c]++] = (uint16_t) g;
+        memset(lane, 0, sizeof(lane));
+      }
+      for (int p = 0; p < Q15_GROUP / 2; p++) {
+        lane[p] += abs(r[2 * p]) + abs(r[2 * p + 1]);
+      }
+    }
+    if (groups > 0) {
+      q15->spanEnd[c][q15->spans[c]++] = (uint16_t) groups;
+    }
+  }
+  return 0;
+}
+
+static int16_t q15_narrow(int64_t acc, uint32_t frac) {
+  if (frac > 0) {
+    acc = (acc + ((int64_t) 1 << (frac - 1))) >> frac; // round half up
+  }
+  return (int16_t) (acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : acc);
+}
+
+void conv_q15(const BinauralFilterQ15* filter, int c, const int16_t* audio, int16_t* output, uint32_t start, uint32_t len) {
+  const int16_t* r = filter->taps[c];
+  const uint16_t* span_end = filter->spanEnd[c];
+  uint32_t spans = filter->spans[c];
+  uint32_t frac = filter->frac[c];
+  if (filter->len[c] == 0) {
+    memset(output + start, 0, len * sizeof(int16_t));
+    return;
+  }
+  // output i is the dot product of the reversed taps with the window ending at audio[i - delay]
+  const int16_t* window = audio - filter->delay[c] - (filter->len[c] - 1);
+
+  for (uint32_t i = start; i < start + len; i++) {
+    const int16_t* x = window + i;
+    int64_t acc = 0;
+#if defined(__AVX2__)
+    __m256i sum = _mm256_setzero_si256();
+    for (uint32_t s = 0, g = 0; s < spans; s++) {
+      __m256i lanes = _mm256_setzero_si256();
+      for (; g < span_end[s]; g++) {
+        __m256i h = _mm256_loadu_si256((const __m256i*) (r + g * Q15_GROUP));
+        __m256i a = _mm256_loadu_si256((const __m256i*) (x + g * Q15_GROUP));
+        lanes = _mm256_add_epi32(lanes, _mm256_madd_epi16(h, a));
+      }
+      sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(lanes)));
+      sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(lanes, 1)));
+    }
+    int64_t parts[4];
+    _mm256_storeu_si256((__m256i*) parts, sum);
+    acc = parts[0] + parts[1] + parts[2] + parts[3];
+#elif defined(__SSE2__)
+    __m128i sum = _mm_setzero_si128();
+    for (uint32_t s = 0, g = 0; s < spans; s++) {
+      // two accumulators so that each lane sees the same tap pairs as the AVX2 lanes
+      __m128i lo = _mm_setzero_si128();
+      __m128i hi = _mm_setzero_si128();
+      for (; g < span_end[s]; g++) {
+        const int16_t* h = r + g * Q15_GROUP;
+        const int16_t* a = x + g * Q15_GROUP;
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_loadu_si128((const __m128i*) h), _mm_loadu_si128((const __m128i*) a)));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_loadu_si128((const __m128i*) (h + 8)), _mm_loadu_si128((const __m128i*) (a + 8))));
+      }
+      // sign extend to 64 bits
+      __m128i lo_sign = _mm_srai_epi32(lo, 31);
+      __m128i hi_sign = _mm_srai_epi32(hi, 31);
+      sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(lo, lo_sign));
+      sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(lo, lo_sign));
+      sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(hi, hi_sign));
+      sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(hi, hi_sign));
+    }
+    int64_t parts[2];
+    _mm_storeu_si128((__m128i*) parts, sum);
+    acc = parts[0] + parts[1];
+#else
+    // spans only matter to the 32-bit vector lanes; here one 64-bit sum gives the same exact result
+    uint32_t taps = span_end[spans - 1] * Q15_GROUP;
+    for (uint32_t k = 0; k < taps; k++) {
+      acc += (int32_t) r[k] * x[k];
+    }
+#endif
+    output[i] = q15_narrow(acc, frac);
+  }
+}
@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FIXED_CONV_
+#define _FIXED_CONV_
+
+#include <stdint.h>
+#include "tinywav.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed-point convolution for int16 (Q15) audio, for targets without an FPU and to skip the
+// float round trip of TW_INT16 files. Filters are quantised to 16 bits with a per-channel
+// exponent (frac fractional bits, so the largest tap uses the full int16 range) and stored
+// time reversed, so each output is one int16 dot product: pmaddwd on SSE2/AVX2, a plain
+// loop elsewhere. Products are summed in 32-bit lanes over spans of taps small enough that
+// no lane can overflow even for full-scale input, then in 64 bits; the result is rounded
+// and saturated to int16. All arithmetic is exact, so every build gives the same output.
+
+#define Q15_GROUP 16            // taps per multiply-add step, filters are zero padded to a multiple
+#define Q15_LANE_LIMIT 65535    // sum of |tap| one 32-bit lane may accumulate: 32768 * 65535 < 2^31
+#define Q15_MAX_GROUPS ((FILTER_SIZE + Q15_GROUP - 1) / Q15_GROUP)
+
+typedef struct BinauralFilterQ15 {
+  int16_t taps[2][Q15_MAX_GROUPS * Q15_GROUP]; ///< time reversed taps, zero padded to whole groups
+  uint32_t len[2];      ///< taps per channel before padding
+  uint32_t delay[2];    ///< onset delay in samples per channel
+  uint32_t frac[2];     ///< fractional bits: the float tap is taps / 2^frac
+  uint32_t spans[2];    ///< number of 32-bit accumulation spans
+  uint16_t spanEnd[2][Q15_MAX_GROUPS]; ///< group index where each span ends
+} BinauralFilterQ15;
+
+/**
+ * Quantise a float filter pair for conv_q15(). The only floating point step of the
+ * fixed-point path, done once per filter.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_filter_to_q15(const BinauralFilter* filter, BinauralFilterQ15* q15);
+
+/**
+ * Same contract as conv_32_delay() for channel c of the filter, on int16 samples:
+ * output[i] = saturate(round(sum of tap[j] * audio[i - delay - j])) for i in [start, start + len).
+ * Like the float kernels it needs FILTER_SIZE - 1 samples of history before audio + start, and
+ * it also reads (but ignores) up to Q15_GROUP - 1 samples past the end of the block.
+ */
+void conv_q15(const BinauralFilterQ15* filter, int c, const int16_t* audio, int16_t* output, uint32_t start, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _FIXED_CONV_
@@ -0,0 +1,1040 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "flac_writer.h"
+
+#if !_WIN32
+#include <pthread.h>
+#endif
+
+#define FLAC_MAX_PARTITION_ORDER 8    // streamable subset limit
+#define FLAC_MAX_RICE_PARAM 30        // 5 bit parameters, 31 is the escape code
+#define FLAC_QLP_PRECISION 15         // bits per quantised LPC coefficient
+#define FLAC_MAX_QLP_SHIFT 15
+#define FLAC_MAX_RESIDUAL (1 << 30)   // larger residuals would overflow the 32 bit zigzag code
+#define FLAC_STREAMINFO_SIZE 34
+
+#define FLAC_PI 3.14159265358979323846
+
+typedef enum FlacSubframeType {
+  FLAC_SUBFRAME_CONSTANT,
+  FLAC_SUBFRAME_VERBATIM,
+  FLAC_SUBFRAME_FIXED,
+  FLAC_SUBFRAME_LPC
+} FlacSubframeType;
+
+typedef struct FlacBits {
+  uint8_t *buf;
+  size_t cap;
+  size_t len;       ///< whole bytes written
+  uint64_t acc;     ///< pending bits, the low accBits of them
+  uint32_t accBits;
+  bool failed;      ///< out of memory
+} FlacBits;
+
+typedef struct FlacRice {
+  uint32_t order;   ///< partition order
+  uint32_t wide;    ///< 1 for 5 bit parameters (any parameter above 14), else 0
+  uint32_t params[1 << FLAC_MAX_PARTITION_ORDER];
+} FlacRice;
+
+typedef struct FlacSubframe {
+  FlacSubframeType type;
+  uint32_t order;
+  int32_t shift;
+  int32_t qlp[FLAC_MAX_LPC_ORDER];
+  FlacRice rice;
+  int32_t *residual; ///< one per sample, the first order unused
+  uint64_t bits;
+} FlacSubframe;
+
+typedef struct FlacWorker {
+  const FlacWriter *fw;
+  uint32_t index;               ///< encodes the frames index, index + threads, ... of a batch
+  uint32_t batchFrames;         ///< frames in the current batch
+  FlacBits out[FLAC_FRAMES_PER_THREAD];
+  int32_t *spare;               ///< residual of the candidate being tried, swapped with sf[].residual
+  int32_t *mid;
+  int32_t *side;
+  double *window;               ///< Tukey window over a full block
+  double *windowed;
+  uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+  FlacRice trial;
+  FlacSubframe sf[4];
+#if !_WIN32
+  pthread_t thread;
+#endif
+} FlacWorker;
+
+// Constant tables, so writers opened on several threads at once share them without setup
+
+// CRC-8 (polynomial x^8 + x^2 + x + 1) of the frame header, byte at a time
+static const uint8_t crc8_table[256] = {
+  0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+  0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+  0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+  0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+  0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+  0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+  0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+  0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+  0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+  0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+  0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+  0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+  0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+  0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+  0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+  0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3
+};
+
+// CRC-16 (polynomial x^16 + x^15 + x^2 + 1) of the whole frame, byte at a time
+static const uint16_t crc16_table[256] = {
+  0x0000, 0x8005, 0x800f, 0x000a, 0x801b, 0x001e, 0x0014, 0x8011,
+  0x8033, 0x0036, 0x003c, 0x8039, 0x0028, 0x802d, 0x8027, 0x0022,
+  0x8063, 0x0066, 0x006c, 0x8069, 0x0078, 0x807d, 0x8077, 0x0072,
+  0x0050, 0x8055, 0x805f, 0x005a, 0x804b, 0x004e, 0x0044, 0x8041,
+  0x80c3, 0x00c6, 0x00cc, 0x80c9, 0x00d8, 0x80dd, 0x80d7, 0x00d2,
+  0x00f0, 0x80f5, 0x80ff, 0x00fa, 0x80eb, 0x00ee, 0x00e4, 0x80e1,
+  0x00a0, 0x80a5, 0x80af, 0x00aa, 0x80bb, 0x00be, 0x00b4, 0x80b1,
+  0x8093, 0x0096, 0x009c, 0x8099, 0x0088, 0x808d, 0x8087, 0x0082,
+  0x8183, 0x0186, 0x018c, 0x8189, 0x0198, 0x819d, 0x8197, 0x0192,
+  0x01b0, 0x81b5, 0x81bf, 0x01ba, 0x81ab, 0x01ae, 0x01a4, 0x81a1,
+  0x01e0, 0x81e5, 0x81ef, 0x01ea, 0x81fb, 0x01fe, 0x01f4, 0x81f1,
+  0x81d3, 0x01d6, 0x01dc, 0x81d9, 0x01c8, 0x81cd, 0x81c7, 0x01c2,
+  0x0140, 0x8145, 0x814f, 0x014a, 0x815b, 0x015e, 0x0154, 0x8151,
+  0x8173, 0x0176, 0x017c, 0x8179, 0x0168, 0x816d, 0x8167, 0x0162,
+  0x8123, 0x0126, 0x012c, 0x8129, 0x0138, 0x813d, 0x8137, 0x0132,
+  0x0110, 0x8115, 0x811f, 0x011a, 0x810b, 0x010e, 0x0104, 0x8101,
+  0x8303, 0x0306, 0x030c, 0x8309, 0x0318, 0x831d, 0x8317, 0x0312,
+  0x0330, 0x8335, 0x833f, 0x033a, 0x832b, 0x032e, 0x0324, 0x8321,
+  0x0360, 0x8365, 0x836f, 0x036a, 0x837b, 0x037e, 0x0374, 0x8371,
+  0x8353, 0x0356, 0x035c, 0x8359, 0x0348, 0x834d, 0x8347, 0x0342,
+  0x03c0, 0x83c5, 0x83cf, 0x03ca, 0x83db, 0x03de, 0x03d4, 0x83d1,
+  0x83f3, 0x03f6, 0x03fc, 0x83f9, 0x03e8, 0x83ed, 0x83e7, 0x03e2,
+  0x83a3, 0x03a6, 0x03ac, 0x83a9, 0x03b8, 0x83bd, 0x83b7, 0x03b2,
+  0x0390, 0x8395, 0x839f, 0x039a, 0x838b, 0x038e, 0x0384, 0x8381,
+  0x0280, 0x8285, 0x828f, 0x028a, 0x829b, 0x029e, 0x0294, 0x8291,
+  0x82b3, 0x02b6, 0x02bc, 0x82b9, 0x02a8, 0x82ad, 0x82a7, 0x02a2,
+  0x82e3, 0x02e6, 0x02ec, 0x82e9, 0x02f8, 0x82fd, 0x82f7, 0x02f2,
+  0x02d0, 0x82d5, 0x82df, 0x02da, 0x82cb, 0x02ce, 0x02c4, 0x82c1,
+  0x8243, 0x0246, 0x024c, 0x8249, 0x0258, 0x825d, 0x8257, 0x0252,
+  0x0270, 0x8275, 0x827f, 0x027a, 0x826b, 0x026e, 0x0264, 0x8261,
+  0x0220, 0x8225, 0x822f, 0x022a, 0x823b, 0x023e, 0x0234, 0x8231,
+  0x8213, 0x0216, 0x021c, 0x8219, 0x0208, 0x820d, 0x8207, 0x0202
+};
+
+// MD5 round constants, floor(abs(sin(i + 1)) * 2^32)
+static const uint32_t md5_k[64] = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+  0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+  0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+  0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+  0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+  0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+  0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+  0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+  0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+  0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+  0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+  0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const uint32_t md5_r[64] = {
+  7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+  5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+// --- bit writer ---
+
+static void bits_byte(FlacBits *bw, uint8_t byte) {
+  if (bw->len == bw->cap) {
+    size_t cap = bw->cap == 0 ? 65536 : 2 * bw->cap;
+    uint8_t *grown = (uint8_t *) realloc(bw->buf, cap);
+    if (grown == NULL) {
+      bw->failed = true;
+      return;
+    }
+    bw->buf = grown;
+    bw->cap = cap;
+  }
+  bw->buf[bw->len++] = byte;
+}
+
+/** Append the low n (at most 32) bits of value, most significant first */
+static void bits_put(FlacBits *bw, uint32_t value, uint32_t n) {
+  if (n == 0) {
+    return;
+  }
+  bw->acc = (bw->acc << n) | (n == 32 ? value : value & ((1u << n) - 1));
+  bw->accBits += n;
+  while (bw->accBits >= 8) {
+    bw->accBits -= 8;
+    bits_byte(bw, (uint8_t) (bw->acc >> bw->accBits));
+  }
+}
+
+static void bits_zeros(FlacBits *bw, uint32_t n) {
+  for (; n > 32; n -= 32) {
+    bits_put(bw, 0, 32);
+  }
+  bits_put(bw, 0, n);
+}
+
+static void bits_align(FlacBits *bw) {
+  if (bw->accBits > 0) {
+    bits_put(bw, 0, 8 - bw->accBits);
+  }
+}
+
+static void bits_reset(FlacBits *bw) {
+  bw->len = 0;
+  bw->acc = 0;
+  bw->accBits = 0;
+  bw->failed = false;
+}
+
+/** Frame numbers are coded like UTF-8 characters */
+static void bits_utf8(FlacBits *bw, uint32_t v) {
+  if (v < 0x80) {
+    bits_put(bw, v, 8);
+    return;
+  }
+  uint32_t bytes = v < 0x800 ? 2 : v < 0x10000 ? 3 : v < 0x200000 ? 4 : v < 0x4000000 ? 5 : 6;
+  bits_put(bw, ((0xFF00u >> bytes) & 0xFF) | (v >> (6 * (bytes - 1))), 8);
+  for (int i = (int) bytes - 2; i >= 0; i--) {
+    bits_put(bw, 0x80 | ((v >> (6 * i)) & 0x3F), 8);
+  }
+}
+
+// --- MD5 of the samples, as signed little-endian integers interleaved by channel ---
+
+static uint32_t md5_rotl(uint32_t x, uint32_t r) { return (x << r) | (x >> (32 - r)); }
+
+static void md5_block(uint32_t h[4], const unsigned char *p) {
+  uint32_t w[16];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (uint32_t) p[4 * i] | ((uint32_t) p[4 * i + 1] << 8) | ((uint32_t) p[4 * i + 2] << 16) | ((uint32_t) p[4 * i + 3] << 24);
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  for (int i = 0; i < 64; i++) {
+    uint32_t f, g;
+    if (i < 16) {
+      f = (b & c) | (~b & d);
+      g = i;
+    } else if (i < 32) {
+      f = (d & b) | (~d & c);
+      g = (5 * i + 1) % 16;
+    } else if (i < 48) {
+      f = b ^ c ^ d;
+      g = (3 * i + 5) % 16;
+    } else {
+      f = c ^ (b | ~d);
+      g = (7 * i) % 16;
+    }
+    uint32_t next = d;
+    d = c;
+    c = b;
+    b = b + md5_rotl(a + f + md5_k[i] + w[g], md5_r[i]);
+    a = next;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+}
+
+static void md5_update(FlacWriter *fw, const unsigned char *data, size_t len) {
+  uint32_t used = (uint32_t) (fw->md5Length % 64);
+  fw->md5Length += len;
+  while (len > 0) {
+    uint32_t take = 64 - used < len ? 64 - used : (uint32_t) len;
+    memcpy(fw->md5Buffer + used, data, take);
+    used += take;
+    data += take;
+    len -= take;
+    if (used == 64) {
+      md5_block(fw->md5State, fw->md5Buffer);
+      used = 0;
+    }
+  }
+}
+
+static void md5_final(FlacWriter *fw, unsigned char digest[16]) {
+  uint64_t bit_length = fw->md5Length * 8;
+  unsigned char pad[72] = {0x80};
+  uint32_t used = (uint32_t) (fw->md5Length % 64);
+  uint32_t pad_len = used < 56 ? 56 - used : 120 - used;
+  for (int i = 0; i < 8; i++) {
+    pad[pad_len + i] = (unsigned char) (bit_length >> (8 * i));
+  }
+  md5_update(fw, pad, pad_len + 8);
+  for (int i = 0; i < 16; i++) {
+    digest[i] = (unsigned char) (fw->md5State[i / 4] >> (8 * (i % 4)));
+  }
+}
+
+// --- residual coding ---
+
+static uint32_t zigzag(int32_t r) {
+  return ((uint32_t) r << 1) ^ (uint32_t) (r >> 31);
+}
+
+/** Bits of a Rice partition of count samples whose zigzag codes sum to sum, at the best parameter */
+static uint64_t rice_partition_bits(uint64_t sum, uint32_t count, uint32_t *param) {
+  uint64_t best = UINT64_MAX;
+  *param = 0;
+  for (uint32_t k = 0; k <= FLAC_MAX_RICE_PARAM; k++) {
+    uint64_t bits = (uint64_t) count * (k + 1) + (sum >> k);
+    if (bits < best) {
+      best = bits;
+      *param = k;
+    }
+  }
+  return best;
+}
+
+/**
+ * Choose the partition order and Rice parameters for a residual. Partition 0 starts after
+ * the order warm-up samples. sums is scratch for one sum per partition.
+ *
+ * @returns the estimated size of the residual section in bits
+ */
+static uint64_t rice_plan(const int32_t *res, uint32_t n, uint32_t order, FlacRice *plan, uint64_t *sums) {
+  uint32_t max_order = 0;
+  while (max_order < FLAC_MAX_PARTITION_ORDER && n % (2u << max_order) == 0 && (n >> (max_order + 1)) > order) {
+    max_order++;
+  }
+
+  uint32_t parts = 1u << max_order;
+  uint32_t size = n >> max_order;
+  for (uint32_t p = 0; p < parts; p++) {
+    uint64_t sum = 0;
+    for (uint32_t i = (p == 0 ? order : p * size); i < (p + 1) * size; i++) {
+      sum += zigzag(res[i]);
+    }
+    sums[p] = sum;
+  }
+
+  uint64_t best = UINT64_MAX;
+  uint32_t params[1 << FLAC_MAX_PARTITION_ORDER];
+  for (int po = (int) max_order; po >= 0; po--) {
+    parts = 1u << po;
+    size = n >> po;
+    uint64_t bits = 0;
+    uint32_t widest = 0;
+    for (uint32_t p = 0; p < parts; p++) {
+      bits += rice_partition_bits(sums[p], size - (p == 0 ? order : 0), &params[p]);
+      widest = params[p] > widest ? params[p] : widest;
+    }
+    uint32_t wide = widest > 14 ? 1 : 0;
+    bits += 2 + 4 + parts * (4 + wide);
+    if (bits < best) {
+      best = bits;
+      plan->order = (uint32_t) po;
+      plan->wide = wide;
+      memcpy(plan->params, params, parts * sizeof(uint32_t));
+    }
+    // sums of the next lower order; ascending p only reads entries not yet overwritten
+    for (uint32_t p = 0; p < parts / 2; p++) {
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+  }
+  return best;
+}
+
+static void rice_write(FlacBits *bw, const int32_t *res, uint32_t n, uint32_t order, const FlacRice *plan) {
+  bits_put(bw, plan->wide, 2);
+  bits_put(bw, plan->order, 4);
+  uint32_t parts = 1u << plan->order;
+  uint32_t size = n >> plan->order;
+  for (uint32_t p = 0; p < parts; p++) {
+    uint32_t k = plan->params[p];
+    bits_put(bw, k, plan->wide ? 5 : 4);
+    for (uint32_t i = (p == 0 ? order : p * size); i < (p + 1) * size; i++) {
+      uint32_t u = zigzag(res[i]);
+      uint32_t q = u >> k;
+      if (q < 32) {
+        bits_put(bw, 1, q + 1); // q zeros, then the stop bit
+      } else {
+        bits_zeros(bw, q);
+        bits_put(bw, 1, 1);
+      }
+      bits_put(bw, u, k);
+    }
+  }
+}
+
+// --- predictors ---
+
+/** @returns false if a residual is too large to code */
+static bool fixed_residual(const int32_t *x, uint32_t n, uint32_t order, int32_t *res) {
+  for (uint32_t i = order; i < n; i++) {
+    int64_t r;
+    switch (order) {
+      case 0: r = x[i]; break;
+      case 1: r = (int64_t) x[i] - x[i - 1]; break;
+      case 2: r = (int64_t) x[i] - 2 * (int64_t) x[i - 1] + x[i - 2]; break;
+      case 3: r = (int64_t) x[i] - 3 * (int64_t) x[i - 1] + 3 * (int64_t) x[i - 2] - x[i - 3]; break;
+      default: r = (int64_t) x[i] - 4 * (int64_t) x[i - 1] + 6 * (int64_t) x[i - 2] - 4 * (int64_t) x[i - 3] + x[i - 4]; break;
+    }
+    if (r >= FLAC_MAX_RESIDUAL || r <= -FLAC_MAX_RESIDUAL) {
+      return false;
+    }
+    res[i] = (int32_t) r;
+  }
+  return true;
+}
+
+static bool lpc_residual(const int32_t *x, uint32_t n, const int32_t *qlp, uint32_t order, int32_t shift, int32_t *res) {
+  for (uint32_t i = order; i < n; i++) {
+    int64_t sum = 0;
+    for (uint32_t j = 0; j < order; j++) {
+      sum += (int64_t) qlp[j] * x[i - 1 - j];
+    }
+    int64_t r = (int64_t) x[i] - (sum >> shift);
+    if (r >= FLAC_MAX_RESIDUAL || r <= -FLAC_MAX_RESIDUAL) {
+      return false;
+    }
+    res[i] = (int32_t) r;
+  }
+  return true;
+}
+
+/** Tukey(0.5) window, flat in the middle and raised cosine over a quarter at each end */
+static void tukey_window(double *w, uint32_t n) {
+  uint32_t taper = n / 4;
+  for (uint32_t i = 0; i < n; i++) {
+    w[i] = 1.0;
+  }
+  for (uint32_t i = 0; i < taper && taper > 1; i++) {
+    double v = 0.5 - 0.5 * cos(FLAC_PI * i / (taper - 1));
+    w[i] = v;
+    w[n - 1 - i] = v;
+  }
+}
+
+/**
+ * Find the LPC predictor with the smallest expected residual: Levinson-Durbin on the
+ * autocorrelation of the windowed block, quantised to FLAC_QLP_PRECISION bits.
+ *
+ * @returns the order, or 0 if no predictor could be built
+ */
+static uint32_t lpc_analyse(FlacWorker *w, const int32_t *x, uint32_t n, uint32_t bps, int32_t *qlp, int32_t *shift) {
+  uint32_t max_order = FLAC_MAX_LPC_ORDER;
+
+  const double *window = w->window;
+  if (n != FLAC_BLOCK_SIZE) {
+    tukey_window(w->windowed, n); // last block of the stream, reuse the buffer for its window
+    for (uint32_t i = 0; i < n; i++) {
+      w->windowed[i] *= x[i];
+    }
+  } else {
+    for (uint32_t i = 0; i < n; i++) {
+      w->windowed[i] = window[i] * x[i];
+    }
+  }
+
+  double autoc[FLAC_MAX_LPC_ORDER + 1];
+  for (uint32_t lag = 0; lag <= max_order; lag++) {
+    double sum = 0;
+    for (uint32_t i = lag; i < n; i++) {
+      sum += w->windowed[i] * w->windowed[i - lag];
+    }
+    autoc[lag] = sum;
+  }
+  if (autoc[0] <= 0) {
+    return 0;
+  }
+
+  // Levinson-Durbin: coefficients and prediction error of every order up to max_order
+  double lpc[FLAC_MAX_LPC_ORDER];
+  double coefs[FLAC_MAX_LPC_ORDER][FLAC_MAX_LPC_ORDER];
+  double error[FLAC_MAX_LPC_ORDER];
+  double err = autoc[0];
+  for (uint32_t i = 0; i < max_order; i++) {
+    double r = -autoc[i + 1];
+    for (uint32_t j = 0; j < i; j++) {
+      r -= lpc[j] * autoc[i - j];
+    }
+    r /= err;
+    lpc[i] = r;
+    for (uint32_t j = 0; j < i / 2; j++) {
+      double tmp = lpc[j];
+      lpc[j] += r * lpc[i - 1 - j];
+      lpc[i - 1 - j] += r * tmp;
+    }
+    if (i & 1) {
+      lpc[i / 2] += lpc[i / 2] * r;
+    }
+    err *= 1.0 - r * r;
+    for (uint32_t j = 0; j <= i; j++) {
+      coefs[i][j] = -lpc[j];
+    }
+    error[i] = err;
+  }
+
+  // order with the fewest expected bits: residual at its predicted size plus the header
+  uint32_t order = 0;
+  double best = 1e300;
+  for (uint32_t i = 0; i < max_order; i++) {
+    double bits_per_sample = error[i] > 0 ? 0.5 * log2(error[i] * 0.5 / n) : 0;
+    bits_per_sample = bits_per_sample > 0 ? bits_per_sample : 0;
+    double bits = bits_per_sample * (n - i - 1) + (i + 1) * (bps + FLAC_QLP_PRECISION);
+    if (bits < best) {
+      best = bits;
+      order = i + 1;
+    }
+  }
+
+  // quantise, feeding each rounding error into the next coefficient
+  const double *c = coefs[order - 1];
+  double cmax = 0;
+  for (uint32_t j = 0; j < order; j++) {
+    cmax = fabs(c[j]) > cmax ? fabs(c[j]) : cmax;
+  }
+  if (cmax <= 0) {
+    return 0;
+  }
+  int log2cmax;
+  frexp(cmax, &log2cmax);
+  *shift = (FLAC_QLP_PRECISION - 1) - (log2cmax - 1) - 1;
+  if (*shift > FLAC_MAX_QLP_SHIFT) {
+    *shift = FLAC_MAX_QLP_SHIFT;
+  } else if (*shift < 0) {
+    return 0;
+  }
+  int32_t qmax = (1 << (FLAC_QLP_PRECISION - 1)) - 1;
+  int32_t qmin = -(1 << (FLAC_QLP_PRECISION - 1));
+  double carry = 0;
+  for (uint32_t j = 0; j < order; j++) {
+    carry += c[j] * (double) (1 << *shift);
+    long q = lround(carry);
+    q = q > qmax ? qmax : q < qmin ? qmin : q;
+    carry -= q;
+    qlp[j] = (int32_t) q;
+  }
+  return order;
+}
+
+/** Pick the smallest coding of one channel. A better candidate's residual is swapped in from *trial */
+static void subframe_analyse(FlacWorker *w, const int32_t *x, uint32_t n, uint32_t bps, FlacSubframe *sf, int32_t **trial) {
+  sf->type = FLAC_SUBFRAME_VERBATIM;
+  sf->order = 0;
+  sf->bits = 8 + (uint64_t) n * bps;
+
+  bool constant = true;
+  for (uint32_t i = 1; i < n && constant; i++) {
+    constant = x[i] == x[0];
+  }
+  if (constant) {
+    sf->type = FLAC_SUBFRAME_CONSTANT;
+    sf->bits = 8 + bps;
+    return;
+  }
+
+  // fixed predictor: the order with the smallest absolute residual, then coded exactly
+  uint32_t fixed_order = 0;
+  if (n > 4) {
+    uint64_t total[5] = {0};
+    for (uint32_t i = 4; i < n; i++) {
+      int64_t e0 = x[i];
+      int64_t e1 = e0 - x[i - 1];
+      int64_t e2 = e1 - ((int64_t) x[i - 1] - x[i - 2]);
+      int64_t e3 = e2 - (((int64_t) x[i - 1] - x[i - 2]) - ((int64_t) x[i - 2] - x[i - 3]));
+      int64_t e4 = e3 - ((((int64_t) x[i - 1] - x[i - 2]) - ((int64_t) x[i - 2] - x[i - 3]))
+                       - (((int64_t) x[i - 2] - x[i - 3]) - ((int64_t) x[i - 3] - x[i - 4])));
+      total[0] += (uint64_t) (e0 < 0 ? -e0 : e0);
+      total[1] += (uint64_t) (e1 < 0 ? -e1 : e1);
+      total[2] += (uint64_t) (e2 < 0 ? -e2 : e2);
+      total[3] += (uint64_t) (e3 < 0 ? -e3 : e3);
+      total[4] += (uint64_t) (e4 < 0 ? -e4 : e4);
+    }
+    for (uint32_t o = 1; o <= 4; o++) {
+      fixed_order = total[o] < total[fixed_order] ? o : fixed_order;
+    }
+  }
+  if (fixed_residual(x, n, fixed_order, *trial)) {
+    uint64_t bits = 8 + (uint64_t) fixed_order * bps + rice_plan(*trial, n, fixed_order, &w->trial, w->sums);
+    if (bits < sf->bits) {
+      int32_t *swap = sf->residual;
+      sf->residual = *trial;
+      *trial = swap;
+      sf->type = FLAC_SUBFRAME_FIXED;
+      sf->order = fixed_order;
+      sf->bits = bits;
+      sf->rice = w->trial;
+    }
+  }
+
+  // LPC predictor
+  int32_t qlp[FLAC_MAX_LPC_ORDER];
+  int32_t shift = 0;
+  uint32_t order = n > 2 * FLAC_MAX_LPC_ORDER ? lpc_analyse(w, x, n, bps, qlp, &shift) : 0;
+  if (order > 0 && lpc_residual(x, n, qlp, order, shift, *trial)) {
+    uint64_t bits = 8 + (uint64_t) order * bps + 4 + 5 + (uint64_t) order * FLAC_QLP_PRECISION
+                  + rice_plan(*trial, n, order, &w->trial, w->sums);
+    if (bits < sf->bits) {
+      int32_t *swap = sf->residual;
+      sf->residual = *trial;
+      *trial = swap;
+      sf->type = FLAC_SUBFRAME_LPC;
+      sf->order = order;
+      sf->shift = shift;
+      memcpy(sf->qlp, qlp, order * sizeof(int32_t));
+      sf->bits = bits;
+      sf->rice = w->trial;
+    }
+  }
+}
+
+static void subframe_write(FlacBits *bw, const FlacSubframe *sf, const int32_t *x, uint32_t n, uint32_t bps) {
+  switch (sf->type) {
+    case FLAC_SUBFRAME_CONSTANT:
+      bits_put(bw, 0x00, 8);
+      bits_put(bw, (uint32_t) x[0], bps);
+      return;
+    case FLAC_SUBFRAME_VERBATIM:
+      bits_put(bw, 0x01 << 1, 8);
+      for (uint32_t i = 0; i < n; i++) {
+        bits_put(bw, (uint32_t) x[i], bps);
+      }
+      return;
+    case FLAC_SUBFRAME_FIXED:
+      bits_put(bw, (0x08 | sf->order) << 1, 8);
+      for (uint32_t i = 0; i < sf->order; i++) {
+        bits_put(bw, (uint32_t) x[i], bps);
+      }
+      rice_write(bw, sf->residual, n, sf->order, &sf->rice);
+      return;
+    case FLAC_SUBFRAME_LPC:
+      bits_put(bw, (0x20 | (sf->order - 1)) << 1, 8);
+      for (uint32_t i = 0; i < sf->order; i++) {
+        bits_put(bw, (uint32_t) x[i], bps);
+      }
+      bits_put(bw, FLAC_QLP_PRECISION - 1, 4);
+      bits_put(bw, (uint32_t) sf->shift, 5);
+      for (uint32_t i = 0; i < sf->order; i++) {
+        bits_put(bw, (uint32_t) sf->qlp[i], FLAC_QLP_PRECISION);
+      }
+      rice_write(bw, sf->residual, n, sf->order, &sf->rice);
+      return;
+  }
+}
+
+// --- frames ---
+
+static uint32_t flac_block_size_code(uint32_t n) {
+  switch (n) {
+    case 192: return 1;
+    case 576: return 2;
+    case 1152: return 3;
+    case 2304: return 4;
+    case 4608: return 5;
+    case 256: return 8;
+    case 512: return 9;
+    case 1024: return 10;
+    case 2048: return 11;
+    case 4096: return 12;
+    case 8192: return 13;
+    case 16384: return 14;
+    case 32768: return 15;
+    default: return n <= 256 ? 6 : 7; // size - 1 follows in 8 or 16 bits
+  }
+}
+
+static uint32_t flac_sample_rate_code(uint32_t rate) {
+  switch (rate) {
+    case 88200: return 1;
+    case 176400: return 2;
+    case 192000: return 3;
+    case 8000: return 4;
+    case 16000: return 5;
+    case 22050: return 6;
+    case 24000: return 7;
+    case 32000: return 8;
+    case 44100: return 9;
+    case 48000: return 10;
+    case 96000: return 11;
+    default: break;
+  }
+  if (rate % 1000 == 0 && rate / 1000 <= 255) {
+    return 12; // kHz in 8 bits
+  }
+  if (rate <= 65535) {
+    return 13; // Hz in 16 bits
+  }
+  return 14; // tens of Hz in 16 bits
+}
+
+/** Encode frame number frame_number of n samples per channel from ch into bw */
+static void flac_encode_frame(FlacWorker *w, int32_t *const *ch, uint32_t n, uint32_t frame_number, FlacBits *bw) {
+  const FlacWriter *fw = w->fw;
+  uint32_t bps = fw->bits;
+  bits_reset(bw);
+
+  // stereo: code two of left, right, mid and side, whichever pair is smallest
+  uint32_t assignment = fw->channels - 1;
+  const int32_t *signal[2] = {ch[0], fw->channels > 1 ? ch[1] : NULL};
+  uint32_t signal_bps[2] = {bps, bps};
+  FlacSubframe *chosen[2] = {&w->sf[0], &w->sf[1]};
+  int32_t *trial = w->spare;
+  if (fw->channels == 2) {
+    for (uint32_t i = 0; i < n; i++) {
+      w->mid[i] = (int32_t) (((int64_t) ch[0][i] + ch[1][i]) >> 1);
+      w->side[i] = ch[0][i] - ch[1][i];
+    }
+    subframe_analyse(w, ch[0], n, bps, &w->sf[0], &trial);
+    subframe_analyse(w, ch[1], n, bps, &w->sf[1], &trial);
+    subframe_analyse(w, w->mid, n, bps, &w->sf[2], &trial);
+    subframe_analyse(w, w->side, n, bps + 1, &w->sf[3], &trial);
+    uint64_t lr = w->sf[0].bits + w->sf[1].bits;
+    uint64_t ls = w->sf[0].bits + w->sf[3].bits;
+    uint64_t sr = w->sf[3].bits + w->sf[1].bits;
+    uint64_t ms = w->sf[2].bits + w->sf[3].bits;
+    if (ms < lr && ms <= ls && ms <= sr) {
+      assignment = 10;
+      signal[0] = w->mid; signal[1] = w->side;
+      signal_bps[1] = bps + 1;
+      chosen[0] = &w->sf[2]; chosen[1] = &w->sf[3];
+    } else if (ls < lr && ls <= sr) {
+      assignment = 8;
+      signal[1] = w->side;
+      signal_bps[1] = bps + 1;
+      chosen[1] = &w->sf[3];
+    } else if (sr < lr) {
+      assignment = 9;
+      signal[0] = w->side;
+      signal_bps[0] = bps + 1;
+      chosen[0] = &w->sf[3];
+    }
+  }
+  w->spare = trial;
+
+  // frame header
+  uint32_t size_code = flac_block_size_code(n);
+  uint32_t rate_code = flac_sample_rate_code(fw->sampleRate);
+  bits_put(bw, 0xFFF8, 16); // sync code, fixed block size
+  bits_put(bw, size_code, 4);
+  bits_put(bw, rate_code, 4);
+  bits_put(bw, assignment, 4);
+  bits_put(bw, bps == 16 ? 4 : 6, 3);
+  bits_put(bw, 0, 1);
+  bits_utf8(bw, frame_number);
+  if (size_code == 6) {
+    bits_put(bw, n - 1, 8);
+  } else if (size_code == 7) {
+    bits_put(bw, n - 1, 16);
+  }
+  if (rate_code == 12) {
+    bits_put(bw, fw->sampleRate / 1000, 8);
+  } else if (rate_code == 13) {
+    bits_put(bw, fw->sampleRate, 16);
+  } else if (rate_code == 14) {
+    bits_put(bw, fw->sampleRate / 10, 16);
+  }
+  uint8_t crc8 = 0;
+  for (size_t i = 0; i < bw->len; i++) {
+    crc8 = crc8_table[crc8 ^ bw->buf[i]];
+  }
+  bits_put(bw, crc8, 8);
+
+  // subframes
+  if (fw->channels == 2) {
+    subframe_write(bw, chosen[0], signal[0], n, signal_bps[0]);
+    subframe_write(bw, chosen[1], signal[1], n, signal_bps[1]);
+  } else {
+    for (uint32_t c = 0; c < fw->channels; c++) {
+      subframe_analyse(w, ch[c], n, bps, &w->sf[0], &w->spare);
+      subframe_write(bw, &w->sf[0], ch[c], n, bps);
+    }
+  }
+
+  bits_align(bw);
+  uint16_t crc16 = 0;
+  for (size_t i = 0; i < bw->len; i++) {
+    crc16 = (uint16_t) ((crc16 << 8) ^ crc16_table[(crc16 >> 8) ^ bw->buf[i]]);
+  }
+  bits_put(bw, crc16, 16);
+}
+
+/** Encode this worker's share of the pending batch */
+static void *flac_worker_run(void *arg) {
+  FlacWorker *w = (FlacWorker *) arg;
+  const FlacWriter *fw = w->fw;
+  for (uint32_t f = w->index, slot = 0; f < w->batchFrames; f += fw->threads, slot++) {
+    uint32_t start = f * FLAC_BLOCK_SIZE;
+    uint32_t n = fw->pendingFrames - start < FLAC_BLOCK_SIZE ? fw->pendingFrames - start : FLAC_BLOCK_SIZE;
+    int32_t *ch[FLAC_MAX_CHANNELS];
+    for (uint32_t c = 0; c < fw->channels; c++) {
+      ch[c] = fw->pending[c] + start;
+    }
+    flac_encode_frame(w, ch, n, fw->frameNumber + f, &w->out[slot]);
+  }
+  return NULL;
+}
+
+static void flac_workers_free(FlacWriter *fw) {
+  if (fw->workers == NULL) {
+    return;
+  }
+  for (uint32_t t = 0; t < fw->threads; t++) {
+    FlacWorker *w = &fw->workers[t];
+    for (int s = 0; s < FLAC_FRAMES_PER_THREAD; s++) {
+      free(w->out[s].buf);
+    }
+    for (int s = 0; s < 4; s++) {
+      free(w->sf[s].residual);
+    }
+    free(w->spare);
+    free(w->mid);
+    free(w->side);
+    free(w->window);
+    free(w->windowed);
+  }
+  free(fw->workers);
+  fw->workers = NULL;
+}
+
+static int flac_workers_alloc(FlacWriter *fw) {
+  fw->workers = (FlacWorker *) calloc(fw->threads, sizeof(FlacWorker));
+  if (fw->workers == NULL) {
+    return -1;
+  }
+  for (uint32_t t = 0; t < fw->threads; t++) {
+    FlacWorker *w = &fw->workers[t];
+    w->fw = fw;
+    w->index = t;
+    for (int s = 0; s < 4; s++) {
+      w->sf[s].residual = (int32_t *) malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+      if (w->sf[s].residual == NULL) {
+        return -1;
+      }
+    }
+    w->spare = (int32_t *) malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    if (w->spare == NULL) {
+      return -1;
+    }
+    w->mid = (int32_t *) malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    w->side = (int32_t *) malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    w->window = (double *) malloc(FLAC_BLOCK_SIZE * sizeof(double));
+    w->windowed = (double *) malloc(FLAC_BLOCK_SIZE * sizeof(double));
+    if (w->mid == NULL || w->side == NULL || w->window == NULL || w->windowed == NULL) {
+      return -1;
+    }
+    tukey_window(w->window, FLAC_BLOCK_SIZE);
+  }
+
+  fw->batchFrames = fw->threads * FLAC_FRAMES_PER_THREAD * FLAC_BLOCK_SIZE;
+  for (uint32_t c = 0; c < fw->channels; c++) {
+    free(fw->pending[c]);
+    fw->pending[c] = (int32_t *) malloc(fw->batchFrames * sizeof(int32_t));
+    if (fw->pending[c] == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** Encode and write all pending samples, the last frame may be short */
+static int flac_flush(FlacWriter *fw) {
+  if (fw->pendingFrames == 0) {
+    return 0;
+  }
+
+  // MD5 over the samples in stream order, interleaved little-endian
+  unsigned char bytes[FLAC_MAX_CHANNELS * 3 * 64];
+  uint32_t sample_bytes = fw->bits / 8;
+  for (uint32_t i = 0; i < fw->pendingFrames; ) {
+    uint32_t len = 0;
+    for (uint32_t k = 0; k < 64 && i < fw->pendingFrames; k++, i++) {
+      for (uint32_t c = 0; c < fw->channels; c++) {
+        int32_t v = fw->pending[c][i];
+        for (uint32_t b = 0; b < sample_bytes; b++) {
+          bytes[len++] = (unsigned char) (v >> (8 * b));
+        }
+      }
+    }
+    md5_update(fw, bytes, len);
+  }
+
+  uint32_t frames = (fw->pendingFrames + FLAC_BLOCK_SIZE - 1) / FLAC_BLOCK_SIZE;
+  uint32_t threads = fw->threads < frames ? fw->threads : frames;
+  for (uint32_t t = 0; t < fw->threads; t++) {
+    fw->workers[t].batchFrames = frames;
+  }
+#if !_WIN32
+  bool started[FLAC_MAX_THREADS] = {false};
+  for (uint32_t t = 1; t < threads; t++) {
+    started[t] = pthread_create(&fw->workers[t].thread, NULL, flac_worker_run, &fw->workers[t]) == 0;
+  }
+  flac_worker_run(&fw->workers[0]);
+  for (uint32_t t = 1; t < threads; t++) {
+    if (started[t]) {
+      pthread_join(fw->workers[t].thread, NULL);
+    } else {
+      flac_worker_run(&fw->workers[t]);
+    }
+  }
+#else
+  for (uint32_t t = 0; t < threads; t++) {
+    flac_worker_run(&fw->workers[t]);
+  }
+#endif
+
+  for (uint32_t f = 0; f < frames; f++) {
+    FlacBits *bw = &fw->workers[f % fw->threads].out[f / fw->threads];
+    if (bw->failed || fwrite(bw->buf, 1, bw->len, fw->f) != bw->len) {
+      return -1;
+    }
+    uint32_t size = (uint32_t) bw->len;
+    fw->minFrameBytes = fw->minFrameBytes == 0 || size < fw->minFrameBytes ? size : fw->minFrameBytes;
+    fw->maxFrameBytes = size > fw->maxFrameBytes ? size : fw->maxFrameBytes;
+  }
+
+  fw->frameNumber += frames;
+  fw->totalSamples += fw->pendingFrames;
+  fw->pendingFrames = 0;
+  return 0;
+}
+
+static int flac_write_stream_info(FlacWriter *fw, const unsigned char md5[16]) {
+  FlacBits bw = {0};
+  bits_put(&bw, 0x80, 8);  // last metadata block, type STREAMINFO
+  bits_put(&bw, FLAC_STREAMINFO_SIZE, 24);
+  bits_put(&bw, FLAC_BLOCK_SIZE, 16); // minimum block size (the last frame may be shorter)
+  bits_put(&bw, FLAC_BLOCK_SIZE, 16); // maximum block size
+  bits_put(&bw, fw->minFrameBytes, 24);
+  bits_put(&bw, fw->maxFrameBytes, 24);
+  bits_put(&bw, fw->sampleRate, 20);
+  bits_put(&bw, fw->channels - 1, 3);
+  bits_put(&bw, fw->bits - 1, 5);
+  bits_put(&bw, (uint32_t) (fw->totalSamples >> 32), 4);
+  bits_put(&bw, (uint32_t) fw->totalSamples, 32);
+  for (int i = 0; i < 16; i++) {
+    bits_put(&bw, md5[i], 8);
+  }
+  int res = (!bw.failed && fwrite(bw.buf, 1, bw.len, fw->f) == bw.len) ? 0 : -1;
+  free(bw.buf);
+  return res;
+}
+
+int flac_writer_open(FlacWriter *fw, FILE *f, uint32_t channels, uint32_t sample_rate, uint32_t bits) {
+
+  if (fw == NULL || f == NULL || channels < 1 || channels > FLAC_MAX_CHANNELS
+      || sample_rate < 1 || sample_rate > 655350 || (bits != 16 && bits != 24)) {
+    return -1;
+  }
+
+  memset(fw, 0, sizeof(FlacWriter));
+  fw->f = f;
+  fw->channels = channels;
+  fw->sampleRate = sample_rate;
+  fw->bits = bits;
+  fw->threads = 1;
+  fw->md5State[0] = 0x67452301;
+  fw->md5State[1] = 0xefcdab89;
+  fw->md5State[2] = 0x98badcfe;
+  fw->md5State[3] = 0x10325476;
+  if (flac_workers_alloc(fw) != 0) {
+    flac_workers_free(fw);
+    return -1;
+  }
+
+  // stream marker and a STREAMINFO to complete on close
+  unsigned char md5[16] = {0};
+  fw->streamInfoOffset = ftell(f) + 4;
+  if (fwrite("fLaC", 1, 4, f) != 4 || flac_write_stream_info(fw, md5) != 0) {
+    flac_workers_free(fw);
+    return -1;
+  }
+  return 0;
+}
+
+int flac_writer_set_threads(FlacWriter *fw, uint32_t threads) {
+  if (fw == NULL || fw->frameNumber > 0 || fw->pendingFrames > 0) {
+    return -1;
+  }
+#if _WIN32
+  threads = 1; // frames are encoded on the calling thread only
+#endif
+  threads = threads < 1 ? 1 : threads > FLAC_MAX_THREADS ? FLAC_MAX_THREADS : threads;
+  flac_workers_free(fw);
+  fw->threads = threads;
+  return flac_workers_alloc(fw);
+}
+
+int flac_writer_write(FlacWriter *fw, const float *const *channels, int stride, int len) {
+
+  if (fw == NULL || channels == NULL || len < 0 || fw->workers == NULL) {
+    return -1;
+  }
+
+  float scale = (float) ((1 << (fw->bits - 1)) - 1);
+  int32_t max = (1 << (fw->bits - 1)) - 1;
+  int32_t min = -(1 << (fw->bits - 1));
+  for (int done = 0; done < len; ) {
+    uint32_t take = fw->batchFrames - fw->pendingFrames;
+    take = (uint32_t) (len - done) < take ? (uint32_t) (len - done) : take;
+    for (uint32_t c = 0; c < fw->channels; c++) {
+      const float *x = channels[c] + (size_t) done * stride;
+      int32_t *dest = fw->pending[c] + fw->pendingFrames;
+      for (uint32_t i = 0; i < take; i++) {
+        long v = lrintf(x[(size_t) i * stride] * scale);
+        dest[i] = (int32_t) (v > max ? max : v < min ? min : v);
+      }
+    }
+    fw->pendingFrames += take;
+    done += (int) take;
+    if (fw->pendingFrames == fw->batchFrames && flac_flush(fw) != 0) {
+      return -1;
+    }
+  }
+  return len;
+}
+
+int flac_writer_close(FlacWriter *fw) {
+
+  if (fw == NULL || fw->workers == NULL) {
+    return -1;
+  }
+
+  int res = flac_flush(fw);
+  unsigned char md5[16];
+  md5_final(fw, md5);
+  long end = ftell(fw->f);
+  if (res == 0 && fseek(fw->f, fw->streamInfoOffset, SEEK_SET) == 0) {
+    res = flac_write_stream_info(fw, md5);
+    fseek(fw->f, end, SEEK_SET);
+  }
+
+  flac_workers_free(fw);
+  for (uint32_t c = 0; c < fw->channels; c++) {
+    free(fw->pending[c]);
+    fw->pending[c] = NULL;
+  }
+  return res;
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLAC_WRITER_
+#define _FLAC_WRITER_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// FLAC encoder for tinywav's TW_FLAC24 output format. Writes a streamable-subset stream of
+// fixed FLAC_BLOCK_SIZE frames: each channel is coded as constant, verbatim, a fixed
+// polynomial predictor (order 0 to 4) or a quantised LPC predictor (order up to
+// FLAC_MAX_LPC_ORDER), whichever is smallest, with partitioned Rice residuals. Stereo picks
+// the smallest of left/right, left/side, side/right and mid/side. Frames are independent, so
+// with more than one thread a batch of frames is encoded in parallel (POSIX only) and
+// written in order. STREAMINFO, including the MD5 of the samples, is completed on close.
+
+#define FLAC_BLOCK_SIZE 4096
+#define FLAC_MAX_LPC_ORDER 8
+#define FLAC_MAX_CHANNELS 8
+#define FLAC_MAX_THREADS 64
+#define FLAC_FRAMES_PER_THREAD 4 // frames each thread encodes per batch
+
+struct FlacWorker;
+
+typedef struct FlacWriter {
+  FILE *f;
+  uint32_t channels;
+  uint32_t sampleRate;
+  uint32_t bits;              ///< bits per sample, 16 or 24
+  uint32_t threads;
+  int32_t *pending[FLAC_MAX_CHANNELS]; ///< samples waiting for a full batch of frames
+  uint32_t pendingFrames;
+  uint32_t batchFrames;       ///< threads * FLAC_FRAMES_PER_THREAD * FLAC_BLOCK_SIZE
+  uint32_t frameNumber;       ///< frames written so far
+  uint64_t totalSamples;      ///< per channel
+  uint32_t minFrameBytes;
+  uint32_t maxFrameBytes;
+  uint32_t md5State[4];
+  uint64_t md5Length;
+  unsigned char md5Buffer[64];
+  struct FlacWorker *workers;
+  long streamInfoOffset;
+} FlacWriter;
+
+/**
+ * Start a FLAC stream on an open, seekable file.
+ *
+ * @param channels     1 to FLAC_MAX_CHANNELS.
+ * @param sample_rate  1 to 655350 Hz.
+ * @param bits         Bits per sample, 16 or 24.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int flac_writer_open(FlacWriter *fw, FILE *f, uint32_t channels, uint32_t sample_rate, uint32_t bits);
+
+/**
+ * Encode frames on the given number of threads (1 by default). Only before the first write.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int flac_writer_set_threads(FlacWriter *fw, uint32_t threads);
+
+/**
+ * Queue float samples in [-1, 1) for encoding. Sample i of channel c is channels[c][i * stride].
+ *
+ * @return  The number of frames (samples per channel) accepted, or -1 on error.
+ */
+int flac_writer_write(FlacWriter *fw, const float *const *channels, int stride, int len);
+
+/**
+ * Encode the remaining samples, complete STREAMINFO and release the encoder.
+ * The file is left open.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int flac_writer_close(FlacWriter *fw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _FLAC_WRITER_
@@ -0,0 +1,332 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h> // for memcpy
+#include <math.h>
+#include <stdio.h>
+#if _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "hrir_db.h"
+
+#define HRIR_DB_PI 3.14159265358979f
+#define HRIR_DB_MAX_WALK 1024 // upper bound on steps of a triangulation walk
+#define HRIR_DB_EPSILON 1e-6f
+
+static void hrir_db_direction(float azimuth, float elevation, float q[3]) {
+  float az = azimuth * HRIR_DB_PI / 180;
+  float el = elevation * HRIR_DB_PI / 180;
+  q[0] = cosf(el) * cosf(az);
+  q[1] = cosf(el) * sinf(az);
+  q[2] = sinf(el);
+}
+
+static float hrir_db_dot(const HrirDbPosition *p, const float q[3]) {
+  return p->X * q[0] + p->Y * q[1] + p->Z * q[2];
+}
+
+/** @returns det[a b c] for three unit vectors */
+static float hrir_db_det(const float a[3], const float b[3], const float c[3]) {
+  return a[0] * (b[1] * c[2] - b[2] * c[1])
+       - a[1] * (b[0] * c[2] - b[2] * c[0])
+       + a[2] * (b[0] * c[1] - b[1] * c[0]);
+}
+
+static void hrir_db_vector(const HrirDb *db, uint32_t idx, float v[3]) {
+  v[0] = db->positions[idx].X;
+  v[1] = db->positions[idx].Y;
+  v[2] = db->positions[idx].Z;
+}
+
+/** @returns true if every triangle, vertex triangle and grid entry refers to an existing position or triangle */
+static bool hrir_db_indices_valid(const HrirDb *db) {
+  const HrirDbHeader *h = &db->h;
+  for (uint32_t t = 0; t < h->NumTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      if (db->triangles[t].Vertices[k] >= h->NumPositions || db->triangles[t].Neighbours[k] >= h->NumTriangles) {
+        return false;
+      }
+    }
+  }
+  for (uint32_t i = 0; h->NumTriangles > 0 && i < h->NumPositions; i++) {
+    if (db->vertexTriangles[i] != HRIR_DB_NONE && db->vertexTriangles[i] >= h->NumTriangles) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < (uint64_t) h->GridRows * h->GridCols; i++) {
+    if (db->grid[i] >= h->NumPositions) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int hrir_db_open(HrirDb *db, const char *path) {
+
+  if (db == NULL || path == NULL) {
+    return -1;
+  }
+  memset(db, 0, sizeof(HrirDb));
+
+#if _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    printf("[hrir_db] Failed to open %s\n", path);
+    return -1;
+  }
+  LARGE_INTEGER size;
+  GetFileSizeEx(file, &size);
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  db->map = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (db->map == NULL) {
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    printf("[hrir_db] Failed to map %s\n", path);
+    return -1;
+  }
+  db->fileHandle = file;
+  db->mapHandle = mapping;
+  db->mapSize = (size_t) size.QuadPart;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("[hrir_db] Failed to open file for reading");
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(HrirDbHeader)) {
+    close(fd);
+    return -1;
+  }
+  void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps its own reference to the file
+  if (map == MAP_FAILED) {
+    perror("[hrir_db] Failed to map file");
+    return -1;
+  }
+  // Queries only touch a handful of filters, so don't let the kernel read ahead
+  madvise(map, (size_t) st.st_size, MADV_RANDOM);
+  db->map = map;
+  db->mapSize = (size_t) st.st_size;
+#endif
+
+  // The header only holds 4 byte fields, so it has no padding and can be copied in one go
+  const uint8_t *base = (const uint8_t *) db->map;
+  memcpy(&db->h, base, sizeof(HrirDbHeader));
+
+  const HrirDbHeader *h = &db->h;
+  uint64_t filterBytes = (uint64_t) h->NumPositions * h->NumChannels * h->FilterSize * sizeof(float);
+  if (memcmp(h->Magic, "HRDB", 4) != 0 || h->Version != HRIR_DB_VERSION
+      || h->NumPositions == 0 || h->GridRows == 0 || h->GridCols == 0
+      || h->FilterSize == 0 || h->NumChannels == 0
+      || (h->PositionsOffset | h->TrianglesOffset | h->VertexTrianglesOffset | h->GridOffset | h->FiltersOffset) % 4 != 0
+      || h->PositionsOffset + (uint64_t) h->NumPositions * sizeof(HrirDbPosition) > db->mapSize
+      || h->TrianglesOffset + (uint64_t) h->NumTriangles * sizeof(HrirDbTriangle) > db->mapSize
+      || h->VertexTrianglesOffset + (uint64_t) h->NumPositions * sizeof(uint32_t) > db->mapSize
+      || h->GridOffset + (uint64_t) h->GridRows * h->GridCols * sizeof(uint32_t) > db->mapSize
+      || h->FiltersOffset + filterBytes > db->mapSize) {
+    printf("[hrir_db] %s is not a valid HRIR database\n", path);
+    hrir_db_close(db);
+    return -1;
+  }
+
+  db->positions = (const HrirDbPosition *) (base + h->PositionsOffset);
+  db->triangles = (const HrirDbTriangle *) (base + h->TrianglesOffset);
+  db->vertexTriangles = (const uint32_t *) (base + h->VertexTrianglesOffset);
+  db->grid = (const uint32_t *) (base + h->GridOffset);
+  db->filters = (const float *) (base + h->FiltersOffset);
+
+  // lookups follow these indices without further checks, so a malformed file is refused here
+  if (!hrir_db_indices_valid(db)) {
+    printf("[hrir_db] %s has an index out of range\n", path);
+    hrir_db_close(db);
+    return -1;
+  }
+
+  return 0;
+}
+
+void hrir_db_close(HrirDb *db) {
+  if (db == NULL || db->map == NULL) {
+    return;
+  }
+#if _WIN32
+  UnmapViewOfFile(db->map);
+  CloseHandle((HANDLE) db->mapHandle);
+  CloseHandle((HANDLE) db->fileHandle);
+#else
+  munmap(db->map, db->mapSize);
+#endif
+  db->map = NULL;
+}
+
+bool hrir_db_isOpen(const HrirDb *db) {
+  return (db != NULL && db->map != NULL);
+}
+
+/** @returns the position stored for the grid cell containing q */
+static uint32_t hrir_db_grid_seed(const HrirDb *db, float azimuth, const float q[3]) {
+  float az = fmodf(azimuth, 360);
+  if (az < 0) az += 360;
+  int row = (int) ((q[2] + 1) * 0.5f * db->h.GridRows);
+  int col = (int) (az / 360 * db->h.GridCols);
+  if (row < 0) row = 0;
+  if (col < 0) col = 0;
+  if (row >= (int) db->h.GridRows) row = db->h.GridRows - 1;
+  if (col >= (int) db->h.GridCols) col = db->h.GridCols - 1;
+  return db->grid[row * db->h.GridCols + col];
+}
+
+int hrir_db_nearest(const HrirDb *db, float azimuth, float elevation) {
+
+  if (!hrir_db_isOpen(db)) {
+    return -1;
+  }
+
+  float q[3];
+  hrir_db_direction(azimuth, elevation, q);
+
+  if (db->h.NumTriangles == 0) {
+    // no triangulation to walk over (coplanar set, e.g. azimuth only), these are small
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < db->h.NumPositions; i++) {
+      if (hrir_db_dot(&db->positions[i], q) > hrir_db_dot(&db->positions[best], q)) {
+        best = i;
+      }
+    }
+    return (int) best;
+  }
+
+  // Greedy walk over the Delaunay graph from the grid seed. On a Delaunay triangulation
+  // this always ends at the true nearest neighbour, and from the seed it takes a step or two.
+  uint32_t best = hrir_db_grid_seed(db, azimuth, q);
+  float bestDot = hrir_db_dot(&db->positions[best], q);
+  for (int step = 0; step < HRIR_DB_MAX_WALK; step++) {
+    uint32_t first = db->vertexTriangles[best];
+    if (first == HRIR_DB_NONE) {
+      break;
+    }
+    uint32_t next = best;
+    uint32_t t = first;
+    // rotate through the triangles around 'best'
+    for (int fan = 0; fan < 64; fan++) {
+      const HrirDbTriangle *tri = &db->triangles[t];
+      int k = (tri->Vertices[0] == best) ? 0 : (tri->Vertices[1] == best) ? 1 : 2;
+      uint32_t v = tri->Vertices[(k + 1) % 3];
+      float d = hrir_db_dot(&db->positions[v], q);
+      if (d > bestDot) {
+        bestDot = d;
+        next = v;
+      }
+      t = tri->Neighbours[(k + 1) % 3];
+      if (t == first) {
+        break;
+      }
+    }
+    if (next == best) {
+      break;
+    }
+    best = next;
+  }
+  return (int) best;
+}
+
+int hrir_db_weights(const HrirDb *db, float azimuth, float elevation, uint32_t idx[3], float w[3]) {
+
+  int nearest = hrir_db_nearest(db, azimuth, elevation);
+  if (nearest < 0) {
+    return -1;
+  }
+
+  uint32_t t = db->h.NumTriangles ? db->vertexTriangles[nearest] : HRIR_DB_NONE;
+  if (t != HRIR_DB_NONE) {
+    float q[3];
+    hrir_db_direction(azimuth, elevation, q);
+
+    // Walk from a triangle at the nearest position towards the one containing q,
+    // always crossing the edge opposite the most negative barycentric coordinate.
+    for (int step = 0; step < HRIR_DB_MAX_WALK; step++) {
+      const HrirDbTriangle *tri = &db->triangles[t];
+      float v[3][3];
+      for (int k = 0; k < 3; k++) {
+        hrir_db_vector(db, tri->Vertices[k], v[k]);
+      }
+      float det = hrir_db_det(v[0], v[1], v[2]);
+      if (fabsf(det) < HRIR_DB_EPSILON) {
+        break;
+      }
+      float b[3];
+      b[0] = hrir_db_det(q, v[1], v[2]) / det;
+      b[1] = hrir_db_det(v[0], q, v[2]) / det;
+      b[2] = hrir_db_det(v[0], v[1], q) / det;
+
+      int worst = 0;
+      for (int k = 1; k < 3; k++) {
+        if (b[k] < b[worst]) worst = k;
+      }
+      float sum = b[0] + b[1] + b[2];
+      if (b[worst] >= -HRIR_DB_EPSILON && sum > 0) {
+        for (int k = 0; k < 3; k++) {
+          idx[k] = tri->Vertices[k];
+          w[k] = (b[k] > 0 ? b[k] : 0) / sum;
+        }
+        return 3;
+      }
+      t = tri->Neighbours[worst];
+    }
+  }
+
+  idx[0] = (uint32_t) nearest;
+  w[0] = 1;
+  return 1;
+}
+
+const float *hrir_db_filter(const HrirDb *db, uint32_t idx, uint32_t channel) {
+  if (!hrir_db_isOpen(db) || idx >= db->h.NumPositions || channel >= db->h.NumChannels) {
+    return NULL;
+  }
+  return db->filters + ((size_t) idx * db->h.NumChannels + channel) * db->h.FilterSize;
+}
+
+int hrir_db_interpolate(const HrirDb *db, float azimuth, float elevation, float **out) {
+
+  if (out == NULL) {
+    return -1;
+  }
+
+  uint32_t idx[3];
+  float w[3];
+  int n = hrir_db_weights(db, azimuth, elevation, idx, w);
+  if (n < 1) {
+    return -1;
+  }
+
+  for (uint32_t c = 0; c < db->h.NumChannels; c++) {
+    memset(out[c], 0, db->h.FilterSize * sizeof(float));
+    for (int k = 0; k < n; k++) {
+      const float *taps = hrir_db_filter(db, idx[k], c);
+      for (uint32_t i = 0; i < db->h.FilterSize; i++) {
+        out[c][i] += w[k] * taps[i];
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _HRIR_DB_
+#define _HRIR_DB_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compiled HRIR database (*.hrdb), produced by utils_python/matToBinary.py (matToDb).
+// All fields are little-endian. Layout:
+//
+//   HrirDbHeader
+//   HrirDbPosition[NumPositions]       measured directions
+//   HrirDbTriangle[NumTriangles]       spherical Delaunay triangulation (convex hull)
+//   uint32_t[NumPositions]             one triangle incident to each position
+//   uint32_t[GridRows * GridCols]      equal-area grid: position nearest to each cell centre
+//   float[NumPositions][NumChannels][FilterSize]   filter taps (page aligned)
+
+#define HRIR_DB_VERSION 1
+#define HRIR_DB_NONE 0xFFFFFFFF
+
+typedef struct HrirDbHeader {
+  char Magic[4];                 // "HRDB"
+  uint32_t Version;
+  uint32_t NumPositions;
+  uint32_t NumTriangles;         // zero if the positions are coplanar (e.g. azimuth only)
+  uint32_t FilterSize;           // taps per channel
+  uint32_t NumChannels;
+  uint32_t SampleRate;
+  uint32_t GridRows;             // bands of equal height in z = sin(elevation)
+  uint32_t GridCols;             // bands of equal width in azimuth
+  uint32_t PositionsOffset;      // byte offsets from the start of the file
+  uint32_t TrianglesOffset;
+  uint32_t VertexTrianglesOffset;
+  uint32_t GridOffset;
+  uint32_t FiltersOffset;
+} HrirDbHeader;
+
+typedef struct HrirDbPosition {
+  float Azimuth;   // degrees
+  float Elevation; // degrees
+  float X, Y, Z;   // unit vector
+} HrirDbPosition;
+
+typedef struct HrirDbTriangle {
+  uint32_t Vertices[3];
+  uint32_t Neighbours[3]; // Neighbours[k] is the triangle across the edge opposite Vertices[k]
+} HrirDbTriangle;
+
+typedef struct HrirDb {
+  void *map;       ///< start of the memory mapped file
+  size_t mapSize;
+#if _WIN32
+  void *fileHandle;
+  void *mapHandle;
+#endif
+  HrirDbHeader h;
+  const HrirDbPosition *positions;
+  const HrirDbTriangle *triangles;
+  const uint32_t *vertexTriangles;
+  const uint32_t *grid;
+  const float *filters; ///< only touched pages are ever read from disk
+} HrirDb;
+
+/**
+ * Map a compiled HRIR database into memory. Filter taps are paged in lazily,
+ * so opening a large set only reads the header and index.
+ *
+ * @param db    The structure to initialise.
+ * @param path  Path to the *.hrdb file.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int hrir_db_open(HrirDb *db, const char *path);
+
+/** Unmap the database. The HrirDb struct is now invalid. */
+void hrir_db_close(HrirDb *db);
+
+/** Returns true if the HrirDb struct holds a mapped database. False otherwise. */
+bool hrir_db_isOpen(const HrirDb *db);
+
+/**
+ * Find the measured position closest to the given direction.
+ * O(1) grid lookup followed by a short greedy walk over the triangulation.
+ *
+ * @return  The position index, or -1 on error.
+ */
+int hrir_db_nearest(const HrirDb *db, float azimuth, float elevation);
+
+/**
+ * Find the triangle of measured positions enclosing the given direction and the
+ * barycentric weights of the direction within it. Falls back to the nearest
+ * position with a weight of 1 if the database has no triangulation.
+ *
+ * @param idx  Receives up to 3 position indices.
+ * @param w    Receives the matching weights, which sum to 1.
+ *
+ * @return  The number of positions written to idx / w, or -1 on error.
+ */
+int hrir_db_weights(const HrirDb *db, float azimuth, float elevation, uint32_t idx[3], float w[3]);
+
+/** @returns a pointer to FilterSize taps of the given position and channel, or NULL if out of range. */
+const float *hrir_db_filter(const HrirDb *db, uint32_t idx, uint32_t channel);
+
+/**
+ * Build the filter for an arbitrary direction by barycentric interpolation of the
+ * three surrounding measurements.
+ *
+ * @param out  One buffer of FilterSize taps per channel.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int hrir_db_interpolate(const HrirDb *db, float azimuth, float elevation, float **out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HRIR_DB_
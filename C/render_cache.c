@@ -0,0 +1,404 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "render_cache.h"
+
+#if !_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#if defined(__linux__)
+#include <linux/fs.h> // for FICLONE
+#endif
+#endif
+
+#define CACHE_READ_CHUNK 65536
+#define CACHE_PATH_SIZE 512
+
+#define HASH_P1 11400714785074694791ULL
+#define HASH_P2 14029467366897019727ULL
+#define HASH_P3 1609587929392839161ULL
+#define HASH_P4 9650029242287828579ULL
+#define HASH_P5 2870177450012600261ULL
+
+// inputs are read little-endian, as are the wav files they come from
+static uint64_t hash_read64(const unsigned char *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static uint32_t hash_read32(const unsigned char *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static uint64_t hash_rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static uint64_t hash_round(uint64_t acc, uint64_t input) {
+  acc += input * HASH_P2;
+  return hash_rotl(acc, 31) * HASH_P1;
+}
+
+static uint64_t hash_merge(uint64_t acc, uint64_t lane) {
+  acc ^= hash_round(0, lane);
+  return acc * HASH_P1 + HASH_P4;
+}
+
+void render_hash_init(RenderHash *hash) {
+  memset(hash, 0, sizeof(RenderHash));
+  hash->lanes[0] = HASH_P1 + HASH_P2;
+  hash->lanes[1] = HASH_P2;
+  hash->lanes[2] = 0;
+  hash->lanes[3] = 0 - HASH_P1;
+}
+
+void render_hash_update(RenderHash *hash, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *) data;
+  hash->total += len;
+
+  // top up a partial stripe first
+  if (hash->buffered > 0) {
+    size_t take = 32 - hash->buffered < len ? 32 - hash->buffered : len;
+    memcpy(hash->buffer + hash->buffered, p, take);
+    hash->buffered += (uint32_t) take;
+    p += take;
+    len -= take;
+    if (hash->buffered < 32) {
+      return;
+    }
+    for (int i = 0; i < 4; i++) {
+      hash->lanes[i] = hash_round(hash->lanes[i], hash_read64(hash->buffer + 8 * i));
+    }
+    hash->buffered = 0;
+  }
+
+  // four independent lanes of 8 bytes per 32 byte stripe
+  for (; len >= 32; p += 32, len -= 32) {
+    for (int i = 0; i < 4; i++) {
+      hash->lanes[i] = hash_round(hash->lanes[i], hash_read64(p + 8 * i));
+    }
+  }
+  memcpy(hash->buffer, p, len);
+  hash->buffered = (uint32_t) len;
+}
+
+uint64_t render_hash_final(const RenderHash *hash) {
+  uint64_t h;
+  if (hash->total >= 32) {
+    h = hash_rotl(hash->lanes[0], 1) + hash_rotl(hash->lanes[1], 7)
+      + hash_rotl(hash->lanes[2], 12) + hash_rotl(hash->lanes[3], 18);
+    for (int i = 0; i < 4; i++) {
+      h = hash_merge(h, hash->lanes[i]);
+    }
+  } else {
+    h = HASH_P5;
+  }
+  h += hash->total;
+
+  const unsigned char *p = hash->buffer;
+  uint32_t left = hash->buffered;
+  for (; left >= 8; p += 8, left -= 8) {
+    h ^= hash_round(0, hash_read64(p));
+    h = hash_rotl(h, 27) * HASH_P1 + HASH_P4;
+  }
+  if (left >= 4) {
+    h ^= (uint64_t) hash_read32(p) * HASH_P1;
+    h = hash_rotl(h, 23) * HASH_P2 + HASH_P3;
+    p += 4;
+    left -= 4;
+  }
+  for (; left > 0; p++, left--) {
+    h ^= (*p) * HASH_P5;
+    h = hash_rotl(h, 11) * HASH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= HASH_P2;
+  h ^= h >> 29;
+  h *= HASH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+static void hash_u32(RenderHash *hash, uint32_t v) {
+  render_hash_update(hash, &v, sizeof(v));
+}
+
+int render_cache_key(const char *audio_file, const BinauralFilter *filter, const BinauralOptions *resolved,
+    uint64_t *key) {
+
+  if (audio_file == NULL || filter == NULL || resolved == NULL || key == NULL) {
+    return -1;
+  }
+
+  RenderHash hash;
+  render_hash_init(&hash);
+
+  // everything that changes the rendered samples; fields one by one, struct padding is undefined
+  hash_u32(&hash, RENDER_CACHE_VERSION);
+  hash_u32(&hash, FILTER_SIZE);
+  hash_u32(&hash, (uint32_t) resolved->outputFormat);
+  render_hash_update(&hash, &resolved->silenceThreshold, sizeof(float));
+  hash_u32(&hash, (uint32_t) resolved->kernel);
+  if (resolved->kernel == BINAURAL_KERNEL_FFT || resolved->silenceThreshold > 0) {
+    // the direct kernel sums in the same order for any block size, the FFT does not, and
+    // above digital silence which blocks are skipped depends on where blocks fall
+    hash_u32(&hash, resolved->blockSize);
+  }
+  if (resolved->kernel == BINAURAL_KERNEL_FFT) {
+    hash_u32(&hash, resolved->fftSize);
+  }
+  for (int c = 0; c < 2; c++) {
+    hash_u32(&hash, filter->len[c]);
+    hash_u32(&hash, filter->delay[c]);
+    render_hash_update(&hash, filter->taps[c], filter->len[c] * sizeof(float));
+  }
+
+  // the input's format and its data chunk only, so retagging a file keeps its entries
+  TinyWav tw;
+  if (tinywav_open_read(&tw, audio_file, TW_SPLIT) != 0) {
+    return -1;
+  }
+  hash_u32(&hash, tw.h.SampleRate);
+  hash_u32(&hash, tw.h.NumChannels);
+  hash_u32(&hash, tw.h.AudioFormat);
+  hash_u32(&hash, tw.h.BitsPerSample);
+
+  // of a time range only the frames it depends on: the range and its filter history
+  uint32_t frames = (uint32_t) tw.numFramesInHeader;
+  uint32_t end = resolved->endFrame < frames ? resolved->endFrame : frames;
+  uint32_t start = resolved->startFrame < end ? resolved->startFrame : end;
+  uint32_t first = start < FILTER_SIZE - 1 ? 0 : start - (FILTER_SIZE - 1);
+  hash_u32(&hash, start);
+  hash_u32(&hash, end);
+  if (first > 0 && tinywav_seek(&tw, first) != 0) {
+    tinywav_close_read(&tw);
+    return -1;
+  }
+
+  unsigned char *chunk = (unsigned char *) malloc(CACHE_READ_CHUNK);
+  if (chunk == NULL) {
+    tinywav_close_read(&tw);
+    return -1;
+  }
+  uint32_t left = (end - first) * tw.numChannels * tw.sampFmt;
+  while (left > 0) {
+    size_t n = fread(chunk, 1, left < CACHE_READ_CHUNK ? left : CACHE_READ_CHUNK, tw.f);
+    if (n == 0) {
+      break; // file shorter than its header claims, the range is hashed already
+    }
+    render_hash_update(&hash, chunk, n);
+    left -= (uint32_t) n;
+  }
+  free(chunk);
+  tinywav_close_read(&tw);
+
+  *key = render_hash_final(&hash);
+  return 0;
+}
+
+#if _WIN32
+
+int render_cache_fetch(const char *cache_dir, uint64_t key, const char *output_path) {
+  return -1;
+}
+
+int render_cache_store(const char *cache_dir, uint64_t max_bytes, uint64_t key, const char *output_path) {
+  return -1;
+}
+
+void render_cache_release(const char *output_path) {
+  // the cache never links files here
+}
+
+#else
+
+void render_cache_release(const char *output_path) {
+  struct stat st;
+  if (output_path != NULL && lstat(output_path, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1) {
+    unlink(output_path);
+  }
+}
+
+static void cache_entry_path(char *path, size_t size, const char *cache_dir, uint64_t key) {
+  snprintf(path, size, "%s/%016llx.wav", cache_dir, (unsigned long long) key);
+}
+
+/** Place a file at dest (which must not exist): reflink, else hard link, else copy */
+static int cache_clone(const char *src, const char *dest) {
+  int in = open(src, O_RDONLY);
+  if (in < 0) {
+    return -1;
+  }
+#ifdef FICLONE
+  int out = open(dest, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (out >= 0 && ioctl(out, FICLONE, in) == 0) {
+    close(out);
+    close(in);
+    return 0;
+  }
+  if (out >= 0) {
+    close(out);
+    unlink(dest);
+  }
+#endif
+  if (link(src, dest) == 0) {
+    close(in);
+    return 0;
+  }
+
+  // different file systems: plain copy
+  int res = -1;
+  int out_copy = open(dest, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  char *chunk = (char *) malloc(CACHE_READ_CHUNK);
+  if (out_copy >= 0 && chunk != NULL) {
+    ssize_t n;
+    res = 0;
+    while ((n = read(in, chunk, CACHE_READ_CHUNK)) > 0) {
+      if (write(out_copy, chunk, (size_t) n) != n) {
+        res = -1;
+        break;
+      }
+    }
+    if (n < 0) {
+      res = -1;
+    }
+  }
+  free(chunk);
+  if (out_copy >= 0) {
+    close(out_copy);
+    if (res != 0) {
+      unlink(dest);
+    }
+  }
+  close(in);
+  return res;
+}
+
+int render_cache_fetch(const char *cache_dir, uint64_t key, const char *output_path) {
+
+  if (cache_dir == NULL || output_path == NULL) {
+    return -1;
+  }
+
+  char entry[CACHE_PATH_SIZE];
+  cache_entry_path(entry, sizeof(entry), cache_dir, key);
+  if (access(entry, R_OK) != 0) {
+    return -1;
+  }
+  utimes(entry, NULL); // mark as most recently used
+
+  // replace rather than overwrite the output, it may be a hard link into the cache
+  unlink(output_path);
+  return cache_clone(entry, output_path);
+}
+
+typedef struct CacheFile {
+  char name[32];
+  int64_t used; ///< modification time in nanoseconds, whole seconds would tie within a batch
+  off_t size;
+} CacheFile;
+
+static int64_t cache_mtime_ns(const struct stat *st) {
+#if defined(__APPLE__)
+  return (int64_t) st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#else
+  return (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+static int cache_file_compare(const void *a, const void *b) {
+  int64_t ta = ((const CacheFile *) a)->used;
+  int64_t tb = ((const CacheFile *) b)->used;
+  return ta < tb ? -1 : ta > tb ? 1 : 0;
+}
+
+/** Delete the least recently used entries until the cache holds at most max_bytes */
+static void cache_evict(const char *cache_dir, uint64_t max_bytes) {
+  DIR *dir = opendir(cache_dir);
+  if (dir == NULL) {
+    return;
+  }
+
+  CacheFile *files = NULL;
+  size_t count = 0, capacity = 0;
+  uint64_t total = 0;
+  struct dirent *e;
+  while ((e = readdir(dir)) != NULL) {
+    // entries only: 16 hex digits + ".wav"
+    if (strlen(e->d_name) != 20 || strcmp(e->d_name + 16, ".wav") != 0) {
+      continue;
+    }
+    char path[CACHE_PATH_SIZE];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, e->d_name);
+    if (stat(path, &st) != 0) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity = capacity == 0 ? 64 : 2 * capacity;
+      CacheFile *grown = (CacheFile *) realloc(files, capacity * sizeof(CacheFile));
+      if (grown == NULL) {
+        break;
+      }
+      files = grown;
+    }
+    strcpy(files[count].name, e->d_name);
+    files[count].used = cache_mtime_ns(&st);
+    files[count].size = st.st_size;
+    total += (uint64_t) st.st_size;
+    count++;
+  }
+  closedir(dir);
+
+  if (total > max_bytes) {
+    qsort(files, count, sizeof(CacheFile), cache_file_compare);
+    for (size_t i = 0; i < count && total > max_bytes; i++) {
+      char path[CACHE_PATH_SIZE];
+      snprintf(path, sizeof(path), "%s/%s", cache_dir, files[i].name);
+      if (unlink(path) == 0) {
+        total -= (uint64_t) files[i].size;
+      }
+    }
+  }
+  free(files);
+}
+
+int render_cache_store(const char *cache_dir, uint64_t max_bytes, uint64_t key, const char *output_path) {
+
+  if (cache_dir == NULL || output_path == NULL) {
+    return -1;
+  }
+  if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+    perror("[render_cache] Failed to create cache directory");
+    return -1;
+  }
+
+  // clone under a temporary name and rename, so concurrent lookups never see a partial entry
+  char entry[CACHE_PATH_SIZE];
+  char temp[CACHE_PATH_SIZE + 32];
+  cache_entry_path(entry, sizeof(entry), cache_dir, key);
+  snprintf(temp, sizeof(temp), "%s.%ld.tmp", entry, (long) getpid());
+  unlink(temp);
+  if (cache_clone(output_path, temp) != 0 || rename(temp, entry) != 0) {
+    unlink(temp);
+    return -1;
+  }
+
+  cache_evict(cache_dir, max_bytes);
+  return 0;
+}
+
+#endif
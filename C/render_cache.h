@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _RENDER_CACHE_
+#define _RENDER_CACHE_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tinywav.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Content-addressed cache of rendered outputs. An entry is the rendered wav stored as
+// <cache dir>/<key>.wav, where the key is a 64-bit hash of the input's format and sample
+// data, the filter taps and delays, and every setting that changes the rendered samples.
+// A hit is handed out as a reflink (copy-on-write clone) where the file system supports it,
+// else a hard link, else a copy; the output path is replaced, never written through.
+// An entry's modification time is its last use, and the least recently used entries are
+// evicted once the cache holds more than its size limit. POSIX only, on Windows every
+// lookup misses.
+
+#define RENDER_CACHE_MAX_BYTES (1024ULL * 1024 * 1024)
+#define RENDER_CACHE_VERSION 1 // bump when the renderer's output changes for the same inputs
+
+/** Streaming 64-bit hash (the XXH64 algorithm) */
+typedef struct RenderHash {
+  uint64_t lanes[4];
+  uint64_t total;          ///< bytes hashed so far
+  unsigned char buffer[32];
+  uint32_t buffered;
+} RenderHash;
+
+void render_hash_init(RenderHash *hash);
+void render_hash_update(RenderHash *hash, const void *data, size_t len);
+uint64_t render_hash_final(const RenderHash *hash);
+
+/**
+ * Compute the cache key of rendering a wav with a filter.
+ *
+ * @param audio_file  The input wav; its header fields and data chunk are hashed, other chunks are not.
+ * @param resolved    The render settings as resolved by binaural_options_resolve().
+ * @param key         Receives the key.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int render_cache_key(const char *audio_file, const BinauralFilter *filter, const BinauralOptions *resolved,
+    uint64_t *key);
+
+/**
+ * Look up a key and on a hit place the cached output at output_path, marking the entry used.
+ *
+ * @return  Zero on a hit, -1 on a miss or error.
+ */
+int render_cache_fetch(const char *cache_dir, uint64_t key, const char *output_path);
+
+/**
+ * Add a freshly rendered output under its key, then evict the least recently used entries
+ * until the cache holds at most max_bytes. The cache directory is created if needed.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int render_cache_store(const char *cache_dir, uint64_t max_bytes, uint64_t key, const char *output_path);
+
+/**
+ * Detach output_path from the cache before a render writes it: a fetch or store may have
+ * left it as a hard link to an entry, which writing in place would overwrite. If it is a
+ * regular file with more than one link it is unlinked, so the writer creates a new file.
+ */
+void render_cache_release(const char *output_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RENDER_CACHE_
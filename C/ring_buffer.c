@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // for memfd_create
+#endif
+
+#include <string.h> // for memmove
+#include <stdlib.h>
+#include "ring_buffer.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define RING_LINEAR_BLOCKS 8 // blocks between two history moves of the linear fallback
+
+#if defined(__linux__)
+/** Map one shared memory object of size bytes twice, back to back. @returns NULL on failure */
+static void *ring_map_mirrored(size_t size) {
+  int fd = memfd_create("binaural_ring", 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, (off_t) size) != 0) {
+    close(fd);
+    return NULL;
+  }
+  // reserve both halves first so nothing else can be mapped in between
+  char *base = (char *) mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+      || mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(base, 2 * size);
+    close(fd);
+    return NULL;
+  }
+  close(fd); // the mappings keep the object alive
+  return base;
+}
+#endif
+
+static int ring_init(RingBuffer *rb, uint32_t history, uint32_t max_block, uint32_t sample_size) {
+
+  if (rb == NULL || max_block < 1) {
+    return -1;
+  }
+
+  memset(rb, 0, sizeof(RingBuffer));
+  rb->history = history;
+  rb->sample_size = sample_size;
+
+#if defined(__linux__)
+  // a power of two of whole pages, so positions wrap with a mask and the mirror lines up
+  uint32_t capacity = (uint32_t) sysconf(_SC_PAGESIZE) / sample_size;
+  while (capacity < history + max_block) {
+    capacity <<= 1;
+  }
+  rb->data = ring_map_mirrored((size_t) capacity * sample_size);
+  if (rb->data != NULL) {
+    rb->capacity = capacity;
+    rb->head = 0; // the history of the first block is the zeroed end of the ring
+    rb->mirrored = true;
+    return 0;
+  }
+#endif
+
+  rb->capacity = history + RING_LINEAR_BLOCKS * max_block;
+  rb->data = calloc(rb->capacity, sample_size);
+  if (rb->data == NULL) {
+    return -1;
+  }
+  rb->head = history; // the history of the first block is zeroed
+  rb->mirrored = false;
+  return 0;
+}
+
+int ring_buffer_init(RingBuffer *rb, uint32_t history, uint32_t max_block) {
+  return ring_init(rb, history, max_block, sizeof(float));
+}
+
+int ring_buffer_init_i16(RingBuffer *rb, uint32_t history, uint32_t max_block) {
+  return ring_init(rb, history, max_block, sizeof(int16_t));
+}
+
+void ring_buffer_free(RingBuffer *rb) {
+  if (rb->data == NULL) {
+    return;
+  }
+#if defined(__linux__)
+  if (rb->mirrored) {
+    munmap(rb->data, 2 * (size_t) rb->capacity * rb->sample_size);
+    rb->data = NULL;
+    return;
+  }
+#endif
+  free(rb->data);
+  rb->data = NULL;
+}
+
+/** Byte address of the window for the next block of len samples */
+static char *ring_window(RingBuffer *rb, uint32_t len) {
+  char *data = (char *) rb->data;
+  if (rb->mirrored) {
+    return data + ((rb->head - rb->history) & (rb->capacity - 1)) * rb->sample_size;
+  }
+  if (rb->head + len > rb->capacity) {
+    // out of room: the history moves back to the front, once every few blocks
+    memmove(data, data + (rb->head - rb->history) * rb->sample_size, (size_t) rb->history * rb->sample_size);
+    rb->head = rb->history;
+  }
+  return data + (rb->head - rb->history) * rb->sample_size;
+}
+
+float *ring_buffer_window(RingBuffer *rb, uint32_t len) {
+  return (float *) ring_window(rb, len);
+}
+
+int16_t *ring_buffer_window_i16(RingBuffer *rb, uint32_t len) {
+  return (int16_t *) ring_window(rb, len);
+}
+
+void ring_buffer_advance(RingBuffer *rb, uint32_t len) {
+  rb->head += len;
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _RING_BUFFER_
+#define _RING_BUFFER_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sample history of one channel for block convolution. Each block is read straight into
+// place behind the history of the previous blocks, and the kernels see history and block
+// as one contiguous window, so nothing is copied from block to block.
+//
+// On Linux the ring is a power of two number of samples mapped twice back to back, so a
+// window running past the end of the ring continues in the mirror at its start. Elsewhere
+// (or if the mapping fails) it is a linear buffer several blocks long whose history is
+// moved back to the front only when the next block no longer fits.
+//
+// Samples are float, or int16 for the fixed-point kernel (ring_buffer_init_i16()).
+
+typedef struct RingBuffer {
+  void *data;           ///< start of the ring (and of its mirror capacity samples further)
+  uint32_t capacity;    ///< samples in the ring
+  uint32_t sample_size; ///< bytes per sample
+  uint32_t history;     ///< frames of history kept in front of each block
+  uint64_t head;        ///< frames written so far (mirrored) or write index (linear)
+  bool mirrored;
+} RingBuffer;
+
+/**
+ * Allocate a zeroed ring for blocks of up to max_block frames.
+ *
+ * @param history    Frames of history in front of each block (FILTER_SIZE - 1).
+ * @param max_block  The longest block that will be passed to ring_buffer_window().
+ *
+ * @return  The error code. Zero if no error.
+ */
+int ring_buffer_init(RingBuffer *rb, uint32_t history, uint32_t max_block);
+
+/** As ring_buffer_init(), for int16 samples read with ring_buffer_window_i16() */
+int ring_buffer_init_i16(RingBuffer *rb, uint32_t history, uint32_t max_block);
+
+/** Release the ring. The RingBuffer struct is now invalid. */
+void ring_buffer_free(RingBuffer *rb);
+
+/**
+ * Contiguous window for the next block of len frames: history frames of history followed
+ * by room for the block. Read the block to window + history, then call ring_buffer_advance().
+ */
+float *ring_buffer_window(RingBuffer *rb, uint32_t len);
+
+/** ring_buffer_window() of a ring set up with ring_buffer_init_i16() */
+int16_t *ring_buffer_window_i16(RingBuffer *rb, uint32_t len);
+
+/** Append the len frames just written behind the window's history */
+void ring_buffer_advance(RingBuffer *rb, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RING_BUFFER_
@@ -0,0 +1,1114 @@
+/**
+ * Copyright (c) 2024 - Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Checks of the render paths against each other. Build and run from the directory holding dataset_bin:
+//   gcc -DTINYWAV_NO_MAIN test_render.c tinywav.c hrir_db.c ambisonics.c fft_conv.c autotune.c conv_kernels.c render_cache.c ring_buffer.c flac_writer.c fixed_conv.c -lm -lpthread
+//   ./a.out
+// The inputs are generated into outputs/. Each check prints ok or FAILED, the exit code is the number of failures.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tinywav.h"
+#include "ambisonics.h"
+#include "render_cache.h"
+#include "conv_kernels.h"
+#include "hrir_db.h"
+
+#define TEST_SAMPLE_RATE 48000
+#define TEST_DEGREES 150
+#define TEST_AMBI_MAX_ILD_ERROR 3.0 // dB between the ambisonic and the direct render
+#define TEST_QUIET_THRESHOLD 1e-3f  // silenceThreshold of the quiet test inputs
+
+static uint32_t test_seed = 1;
+
+/** Deterministic noise in [-0.5, 0.5) */
+static float test_noise(void) {
+  test_seed = test_seed * 1664525u + 1013904223u;
+  return (float) (test_seed >> 8) / (1 << 24) - 0.5f;
+}
+
+/**
+ * Write a 2 channel test input of noise bursts and stretches of digital silence, so the
+ * silent block skipping is exercised too. With mono set both channels carry the same signal.
+ */
+static int test_write_input(const char* path, uint32_t frames, TinyWavSampleFormat format, bool mono) {
+  TinyWav tw;
+  if (tinywav_open_write(&tw, 2, TEST_SAMPLE_RATE, format, TW_SPLIT, path) != 0) {
+    return -1;
+  }
+  float block[2][CONVOLVE_BLOCK_SIZE];
+  float* ptrs[2] = {block[0], block[1]};
+  for (uint32_t done = 0; done < frames; ) {
+    uint32_t n = frames - done < CONVOLVE_BLOCK_SIZE ? frames - done : CONVOLVE_BLOCK_SIZE;
+    for (uint32_t i = 0; i < n; i++) {
+      bool burst = ((done + i) / 3000) % 3 != 2; // 6000 frames of noise, 3000 of silence
+      block[0][i] = burst ? test_noise() : 0.0f;
+      block[1][i] = mono ? block[0][i] : burst ? test_noise() : 0.0f;
+    }
+    tinywav_write_f(&tw, ptrs, n);
+    done += n;
+  }
+  tinywav_close_write(&tw);
+  return 0;
+}
+
+/** Render audio_file to output_path with binaural_render(), as a float wav */
+/**
+ * Write a 2 channel test input whose every odd block of `block` frames opens with a loud
+ * quarter, the rest being noise below a silenceThreshold of TEST_QUIET_THRESHOLD. A block
+ * whose last FILTER_SIZE - 1 frames are quiet then still counts as loud.
+ */
+static int test_write_quiet_input(const char* path, uint32_t frames, uint32_t block, TinyWavSampleFormat format) {
+  TinyWav tw;
+  if (tinywav_open_write(&tw, 2, TEST_SAMPLE_RATE, format, TW_SPLIT, path) != 0) {
+    return -1;
+  }
+  for (uint32_t f = 0; f < frames; f++) {
+    float scale = (f / block) % 2 == 1 && f % block < block / 4 ? 1.0f : 1e-4f;
+    float frame[2] = {scale * test_noise(), scale * test_noise()};
+    float* ptrs[2] = {&frame[0], &frame[1]};
+    tinywav_write_f(&tw, ptrs, 1);
+  }
+  tinywav_close_write(&tw);
+  return 0;
+}
+
+/**
+ * Write a 2 channel test input cycling through stretches of independent noise, digital
+ * silence, a sine and the same noise on both channels, so the FLAC encoding of its render
+ * takes constant, verbatim, fixed and LPC subframes and several stereo decorrelations.
+ */
+static int test_write_flac_input(const char* path, uint32_t frames) {
+  TinyWav tw;
+  if (tinywav_open_write(&tw, 2, TEST_SAMPLE_RATE, TW_FLOAT32, TW_SPLIT, path) != 0) {
+    return -1;
+  }
+  for (uint32_t f = 0; f < frames; f++) {
+    uint32_t stretch = (f / 16384) % 4;
+    float left = stretch == 1 ? 0.0f : stretch == 2 ? 0.5f * sinf(0.01f * (float) f) : test_noise();
+    float frame[2] = {left, stretch == 0 ? test_noise() : left};
+    float* ptrs[2] = {&frame[0], &frame[1]};
+    tinywav_write_f(&tw, ptrs, 1);
+  }
+  tinywav_close_write(&tw);
+  return 0;
+}
+
+static int test_render(const char* audio_file, const char* output_path, BinauralFilter* filter,
+    const BinauralOptions* options) {
+  TinyWav tw, tw_out;
+  if (tinywav_open_read(&tw, audio_file, TW_SPLIT) != 0) {
+    return -1;
+  }
+  if (tinywav_open_write(&tw_out, 2, (int32_t) tw.h.SampleRate, TW_FLOAT32, TW_SPLIT, output_path) != 0) {
+    tinywav_close_read(&tw);
+    return -1;
+  }
+  int res = binaural_render(&tw, &tw_out, filter, options, NULL);
+  tinywav_close_write(&tw_out);
+  tinywav_close_read(&tw);
+  return res;
+}
+
+/**
+ * Compare the samples of two wav files.
+ *
+ * @param max_error    Receives the largest difference of a sample.
+ * @param correlation  Receives the normalised cross-correlation at lag 0, or NULL.
+ *
+ * @return  The error code. Zero if both files have the same channels and length.
+ */
+static int test_compare(const char* a_path, const char* b_path, double* max_error, double* correlation) {
+  TinyWav a, b;
+  if (tinywav_open_read(&a, a_path, TW_SPLIT) != 0) {
+    return -1;
+  }
+  if (tinywav_open_read(&b, b_path, TW_SPLIT) != 0) {
+    tinywav_close_read(&a);
+    return -1;
+  }
+  int res = a.numChannels == b.numChannels && a.numFramesInHeader == b.numFramesInHeader ? 0 : -1;
+  float x[2][CONVOLVE_BLOCK_SIZE], y[2][CONVOLVE_BLOCK_SIZE];
+  float* x_ptrs[2] = {x[0], x[1]};
+  float* y_ptrs[2] = {y[0], y[1]};
+  double xy = 0, xx = 0, yy = 0;
+  int n;
+  *max_error = 0;
+  while (res == 0 && (n = tinywav_read_f(&a, x_ptrs, CONVOLVE_BLOCK_SIZE)) > 0) {
+    if (tinywav_read_f(&b, y_ptrs, n) != n) {
+      res = -1;
+      break;
+    }
+    for (int c = 0; c < a.numChannels; c++) {
+      for (int i = 0; i < n; i++) {
+        double e = fabs((double) x[c][i] - y[c][i]);
+        *max_error = e > *max_error ? e : *max_error;
+        xy += (double) x[c][i] * y[c][i];
+        xx += (double) x[c][i] * x[c][i];
+        yy += (double) y[c][i] * y[c][i];
+      }
+    }
+  }
+  if (correlation != NULL) {
+    *correlation = xx > 0 && yy > 0 ? xy / sqrt(xx * yy) : 0;
+  }
+  tinywav_close_read(&a);
+  tinywav_close_read(&b);
+  return res;
+}
+
+/**
+ * Signal to noise ratio of an int16 render against the float render of the same input, in dB.
+ * The float render is clipped to the int16 range first, as the fixed-point path saturates there.
+ *
+ * @param max_error  Receives the largest difference of a sample in int16 steps.
+ *
+ * @return  The SNR, or -INFINITY if the files cannot be read or differ in length.
+ */
+static double test_snr(const char* float_path, const char* fixed_path, double* max_error) {
+  TinyWav ref, fixed;
+  if (tinywav_open_read(&ref, float_path, TW_SPLIT) != 0) {
+    return -INFINITY;
+  }
+  if (tinywav_open_read(&fixed, fixed_path, TW_SPLIT) != 0) {
+    tinywav_close_read(&ref);
+    return -INFINITY;
+  }
+  bool same_length = ref.numFramesInHeader == fixed.numFramesInHeader && ref.numFramesInHeader > 0;
+  float a[2][CONVOLVE_BLOCK_SIZE], b[2][CONVOLVE_BLOCK_SIZE];
+  float* a_ptrs[2] = {a[0], a[1]};
+  float* b_ptrs[2] = {b[0], b[1]};
+  const float lowest = (float) INT16_MIN / INT16_MAX;
+  double signal = 0, noise = 0;
+  int n;
+  *max_error = 0;
+  while (same_length && (n = tinywav_read_f(&ref, a_ptrs, CONVOLVE_BLOCK_SIZE)) > 0) {
+    if (tinywav_read_f(&fixed, b_ptrs, n) != n) {
+      same_length = false;
+      break;
+    }
+    for (int c = 0; c < 2; c++) {
+      for (int i = 0; i < n; i++) {
+        float clipped = a[c][i] > 1.0f ? 1.0f : a[c][i] < lowest ? lowest : a[c][i];
+        double e = (double) b[c][i] - clipped;
+        signal += (double) a[c][i] * a[c][i];
+        noise += e * e;
+        *max_error = fabs(e) * INT16_MAX > *max_error ? fabs(e) * INT16_MAX : *max_error;
+      }
+    }
+  }
+  tinywav_close_read(&ref);
+  tinywav_close_read(&fixed);
+  if (!same_length) {
+    return -INFINITY;
+  }
+  return noise > 0 ? 10 * log10(signal / noise) : INFINITY;
+}
+
+/** @returns the interaural level difference of a 2 channel wav in dB, left over right */
+static double test_ild(const char* path) {
+  TinyWav tw;
+  if (tinywav_open_read(&tw, path, TW_SPLIT) != 0) {
+    return NAN;
+  }
+  float x[2][CONVOLVE_BLOCK_SIZE];
+  float* ptrs[2] = {x[0], x[1]};
+  double energy[2] = {0, 0};
+  int n;
+  while ((n = tinywav_read_f(&tw, ptrs, CONVOLVE_BLOCK_SIZE)) > 0) {
+    for (int c = 0; c < 2; c++) {
+      for (int i = 0; i < n; i++) {
+        energy[c] += (double) x[c][i] * x[c][i];
+      }
+    }
+  }
+  tinywav_close_read(&tw);
+  return 10 * log10(energy[0] / energy[1]);
+}
+
+/** @returns true if both files exist and hold the same bytes */
+static bool test_same_bytes(const char* a_path, const char* b_path) {
+  FILE* a = fopen(a_path, "rb");
+  FILE* b = fopen(b_path, "rb");
+  bool same = a != NULL && b != NULL;
+  while (same) {
+    int x = fgetc(a);
+    int y = fgetc(b);
+    same = x == y;
+    if (x == EOF || y == EOF) {
+      break;
+    }
+  }
+  if (a != NULL) fclose(a);
+  if (b != NULL) fclose(b);
+  return same;
+}
+
+/**
+ * @returns true if the sample data of part_path equals that of whole_path from frame `first`
+ * on, byte for byte (both files in the same sample format)
+ */
+static bool test_same_frames(const char* whole_path, uint32_t first, const char* part_path) {
+  TinyWav whole, part;
+  if (tinywav_open_read(&whole, whole_path, TW_SPLIT) != 0) {
+    return false;
+  }
+  if (tinywav_open_read(&part, part_path, TW_SPLIT) != 0) {
+    tinywav_close_read(&whole);
+    return false;
+  }
+  uint32_t frame_bytes = (uint32_t) whole.numChannels * whole.sampFmt;
+  bool same = whole.sampFmt == part.sampFmt && whole.numChannels == part.numChannels
+      && part.numFramesInHeader > 0 && first + (uint32_t) part.numFramesInHeader <= (uint32_t) whole.numFramesInHeader
+      && tinywav_seek(&whole, first) == 0;
+  for (uint32_t i = 0; same && i < (uint32_t) part.numFramesInHeader * frame_bytes; i++) {
+    same = fgetc(whole.f) == fgetc(part.f);
+  }
+  tinywav_close_read(&whole);
+  tinywav_close_read(&part);
+  return same;
+}
+
+/** Copy a file, to keep a rendered output for comparison */
+static int test_copy(const char* src_path, const char* dest_path) {
+  FILE* src = fopen(src_path, "rb");
+  FILE* dest = src != NULL ? fopen(dest_path, "wb") : NULL;
+  int res = dest != NULL ? 0 : -1;
+  int c;
+  while (res == 0 && (c = fgetc(src)) != EOF) {
+    res = fputc(c, dest) == EOF ? -1 : 0;
+  }
+  if (src != NULL) fclose(src);
+  if (dest != NULL) fclose(dest);
+  return res;
+}
+
+/** FLAC bits, most significant first. Reads past the end give zeros and set overrun */
+typedef struct TestBits {
+  const unsigned char* buf;
+  size_t len;   ///< bytes
+  size_t pos;   ///< bits read
+  bool overrun;
+} TestBits;
+
+static uint32_t test_bits(TestBits* b, uint32_t n) {
+  uint32_t v = 0;
+  for (uint32_t i = 0; i < n; i++, b->pos++) {
+    size_t byte = b->pos >> 3;
+    b->overrun |= byte >= b->len;
+    v = (v << 1) | (byte < b->len ? (b->buf[byte] >> (7 - (b->pos & 7))) & 1u : 0u);
+  }
+  return v;
+}
+
+static int32_t test_bits_signed(TestBits* b, uint32_t n) {
+  uint32_t v = test_bits(b, n);
+  return n > 0 && n < 32 && (v >> (n - 1)) != 0 ? (int32_t) (v - (1u << n)) : (int32_t) v;
+}
+
+/** CRC-8 (poly 0x07) or CRC-16 (poly 0x8005) of a FLAC frame header or frame */
+static uint32_t test_crc(const unsigned char* p, size_t len, uint32_t bits, uint32_t poly) {
+  uint32_t mask = (1u << bits) - 1;
+  uint32_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint32_t) p[i] << (bits - 8);
+    for (int k = 0; k < 8; k++) {
+      crc = (crc & (1u << (bits - 1))) != 0 ? ((crc << 1) ^ poly) & mask : (crc << 1) & mask;
+    }
+  }
+  return crc;
+}
+
+/** MD5 (RFC 1321) of len bytes */
+static void test_md5(const unsigned char* data, size_t len, unsigned char digest[16]) {
+  static const uint32_t r[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+      5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 4, 11, 16, 23, 4, 11, 16, 23,
+      4, 11, 16, 23, 4, 11, 16, 23, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+  uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+  size_t padded = (len + 8) / 64 * 64 + 64;
+  unsigned char* msg = (unsigned char *) calloc(padded, 1);
+  if (msg == NULL) {
+    memset(digest, 0, 16);
+    return;
+  }
+  memcpy(msg, data, len);
+  msg[len] = 0x80;
+  for (int i = 0; i < 8; i++) {
+    msg[padded - 8 + i] = (unsigned char) (((uint64_t) len * 8) >> (8 * i));
+  }
+  for (size_t block = 0; block < padded; block += 64) {
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+      const unsigned char* p = msg + block + 4 * i;
+      w[i] = p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    for (uint32_t i = 0; i < 64; i++) {
+      uint32_t f, g;
+      if (i < 16) {
+        f = (b & c) | (~b & d);
+        g = i;
+      } else if (i < 32) {
+        f = (d & b) | (~d & c);
+        g = (5 * i + 1) % 16;
+      } else if (i < 48) {
+        f = b ^ c ^ d;
+        g = (3 * i + 5) % 16;
+      } else {
+        f = c ^ (b | ~d);
+        g = (7 * i) % 16;
+      }
+      uint32_t k = (uint32_t) floor(fabs(sin(i + 1.0)) * 4294967296.0);
+      uint32_t x = a + f + k + w[g];
+      a = d;
+      d = c;
+      c = b;
+      b += (x << r[i]) | (x >> (32 - r[i]));
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+  }
+  for (int i = 0; i < 16; i++) {
+    digest[i] = (unsigned char) (h[i / 4] >> (8 * (i % 4)));
+  }
+  free(msg);
+}
+
+/** Decode a partitioned Rice residual of n - order samples into res[order] on */
+static bool test_flac_residual(TestBits* b, int32_t* res, uint32_t n, uint32_t order) {
+  uint32_t method = test_bits(b, 2);
+  uint32_t param_bits = method == 0 ? 4 : 5;
+  uint32_t escape = (1u << param_bits) - 1;
+  uint32_t partition_order = test_bits(b, 4);
+  uint32_t size = n >> partition_order;
+  if (method > 1 || size << partition_order != n || size < order) {
+    return false;
+  }
+  for (uint32_t p = 0; p < (1u << partition_order); p++) {
+    uint32_t k = test_bits(b, param_bits);
+    uint32_t raw = k == escape ? test_bits(b, 5) : 0;
+    for (uint32_t i = (p == 0 ? order : p * size); i < (p + 1) * size; i++) {
+      if (k == escape) {
+        res[i] = test_bits_signed(b, raw);
+        continue;
+      }
+      uint32_t q = 0;
+      while (test_bits(b, 1) == 0) {
+        if (b->overrun) {
+          return false;
+        }
+        q++;
+      }
+      uint32_t u = (q << k) | test_bits(b, k);
+      res[i] = (int32_t) (u >> 1) ^ -(int32_t) (u & 1);
+    }
+  }
+  return !b->overrun;
+}
+
+/** Decode one subframe of n samples of bps bits into x. @returns false if it is malformed */
+static bool test_flac_subframe(TestBits* b, int32_t* x, uint32_t n, uint32_t bps) {
+  static const int32_t fixed[5][4] = {{0}, {1}, {2, -1}, {3, -3, 1}, {4, -6, 4, -1}};
+  if (test_bits(b, 1) != 0) {
+    return false;
+  }
+  uint32_t type = test_bits(b, 6);
+  uint32_t wasted = 0;
+  if (test_bits(b, 1) != 0) {
+    for (wasted = 1; test_bits(b, 1) == 0 && !b->overrun; wasted++) {
+    }
+  }
+  if (wasted >= bps) {
+    return false;
+  }
+  bps -= wasted;
+
+  if (type == 0) {
+    int32_t v = test_bits_signed(b, bps);
+    for (uint32_t i = 0; i < n; i++) {
+      x[i] = v;
+    }
+  } else if (type == 1) {
+    for (uint32_t i = 0; i < n; i++) {
+      x[i] = test_bits_signed(b, bps);
+    }
+  } else if ((type >= 8 && type <= 12) || type >= 32) {
+    // fixed polynomial or LPC: warm-up samples, coefficients, residual, then the prediction
+    uint32_t order = type >= 32 ? type - 31 : type - 8;
+    int32_t coefs[32];
+    int32_t shift = 0;
+    if (order > n) {
+      return false;
+    }
+    for (uint32_t i = 0; i < order; i++) {
+      x[i] = test_bits_signed(b, bps);
+    }
+    if (type >= 32) {
+      uint32_t precision = test_bits(b, 4) + 1;
+      shift = test_bits_signed(b, 5);
+      if (precision == 16 || shift < 0) {
+        return false;
+      }
+      for (uint32_t j = 0; j < order; j++) {
+        coefs[j] = test_bits_signed(b, precision);
+      }
+    } else {
+      memcpy(coefs, fixed[order], sizeof(fixed[order]));
+    }
+    if (!test_flac_residual(b, x, n, order)) {
+      return false;
+    }
+    for (uint32_t i = order; i < n; i++) {
+      int64_t sum = 0;
+      for (uint32_t j = 0; j < order; j++) {
+        sum += (int64_t) coefs[j] * x[i - 1 - j];
+      }
+      x[i] += (int32_t) (sum >> shift);
+    }
+  } else {
+    return false;
+  }
+  for (uint32_t i = 0; wasted > 0 && i < n; i++) {
+    x[i] = (int32_t) ((uint32_t) x[i] << wasted);
+  }
+  return !b->overrun;
+}
+
+/**
+ * Decode a 2 channel FLAC stream written with fixed block sizes, as flac_writer.c writes them,
+ * checking the CRC-8 and CRC-16 of every frame and the MD5 of the samples in STREAMINFO.
+ *
+ * @param samples  Receives a malloc'ed buffer of samples per channel.
+ * @param frames   Receives the number of samples per channel.
+ *
+ * @return  The error code. Zero if the stream decoded and every check passed.
+ */
+static int test_flac_decode(const char* path, int32_t* samples[2], uint32_t* frames) {
+  samples[0] = samples[1] = NULL;
+  *frames = 0;
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char* buf = size > 4 ? (unsigned char *) malloc((size_t) size) : NULL;
+  bool ok = buf != NULL && fread(buf, 1, (size_t) size, f) == (size_t) size && memcmp(buf, "fLaC", 4) == 0;
+  fclose(f);
+  TestBits b = {buf, ok ? (size_t) size : 0, 32, false};
+
+  // metadata blocks, STREAMINFO first
+  uint32_t channels = 0, bps = 0;
+  uint64_t total = 0;
+  unsigned char md5[16] = {0};
+  for (bool last = !ok; !last && !b.overrun; ) {
+    last = test_bits(&b, 1) != 0;
+    uint32_t type = test_bits(&b, 7);
+    size_t length = test_bits(&b, 24);
+    size_t next = b.pos + length * 8;
+    if (type == 0) {
+      test_bits(&b, 16 + 16 + 24 + 24 + 20); // block and frame sizes, sample rate
+      channels = test_bits(&b, 3) + 1;
+      bps = test_bits(&b, 5) + 1;
+      total = (uint64_t) test_bits(&b, 4) << 32;
+      total |= test_bits(&b, 32);
+      for (int i = 0; i < 16; i++) {
+        md5[i] = (unsigned char) test_bits(&b, 8);
+      }
+    }
+    b.pos = next;
+  }
+  ok = ok && !b.overrun && channels == 2 && bps % 8 == 0 && bps <= 24 && total > 0 && total <= UINT32_MAX;
+  int32_t* sub = ok ? (int32_t *) malloc(2 * 65536 * sizeof(int32_t)) : NULL;
+  for (int c = 0; ok && c < 2; c++) {
+    samples[c] = (int32_t *) malloc((size_t) total * sizeof(int32_t));
+    ok = samples[c] != NULL;
+  }
+  ok = ok && sub != NULL;
+
+  uint32_t done = 0;
+  for (uint32_t number = 0; ok && done < total; number++) {
+    // frame header
+    size_t start = b.pos / 8;
+    ok = test_bits(&b, 16) == 0xFFF8; // sync code, fixed block size
+    uint32_t size_code = test_bits(&b, 4);
+    uint32_t rate_code = test_bits(&b, 4);
+    uint32_t assignment = test_bits(&b, 4);
+    uint32_t bps_code = test_bits(&b, 3);
+    test_bits(&b, 1);
+    uint32_t first = test_bits(&b, 8); // frame number, UTF-8 coded
+    uint32_t ones = 0;
+    while (ones < 8 && (first & (0x80u >> ones)) != 0) {
+      ones++;
+    }
+    uint32_t value = first & (0xFFu >> (ones + 1));
+    for (uint32_t i = 1; i < ones; i++) {
+      value = (value << 6) | (test_bits(&b, 8) & 0x3F);
+    }
+    uint32_t n = size_code == 0 ? 0 : size_code == 1 ? 192 : size_code <= 5 ? 576u << (size_code - 2)
+        : size_code == 6 ? test_bits(&b, 8) + 1 : size_code == 7 ? test_bits(&b, 16) + 1 : 256u << (size_code - 8);
+    test_bits(&b, rate_code == 12 ? 8 : rate_code == 13 || rate_code == 14 ? 16 : 0);
+    uint32_t frame_bps = bps_code == 0 ? bps : bps_code == 4 ? 16 : bps_code == 6 ? 24 : 0;
+    uint32_t crc8 = test_crc(buf + start, b.pos / 8 - start, 8, 0x07);
+    ok = ok && test_bits(&b, 8) == crc8 && value == number && n > 0 && n <= total - done
+        && frame_bps == bps && (assignment == 1 || (assignment >= 8 && assignment <= 10));
+
+    // subframes, the side channel one bit wider
+    for (uint32_t c = 0; ok && c < 2; c++) {
+      bool side = (assignment == 8 || assignment == 10) ? c == 1 : assignment == 9 && c == 0;
+      ok = test_flac_subframe(&b, sub + c * 65536, n, bps + (side ? 1 : 0));
+    }
+    b.pos = (b.pos + 7) & ~(size_t) 7;
+    uint32_t crc16 = ok ? test_crc(buf + start, b.pos / 8 - start, 16, 0x8005) : 0;
+    ok = ok && test_bits(&b, 16) == crc16 && !b.overrun;
+
+    for (uint32_t i = 0; ok && i < n; i++) {
+      int64_t x = sub[i], y = sub[65536 + i];
+      int64_t mid = x * 2 + (y & 1);
+      samples[0][done + i] = (int32_t) (assignment == 9 ? x + y : assignment == 10 ? (mid + y) >> 1 : x);
+      samples[1][done + i] = (int32_t) (assignment == 8 ? x - y : assignment == 10 ? (mid - y) >> 1 : y);
+    }
+    done += n;
+  }
+  ok = ok && b.pos / 8 == b.len;
+
+  // MD5 over the samples interleaved little-endian
+  uint32_t sample_bytes = bps / 8;
+  unsigned char* bytes = ok ? (unsigned char *) malloc((size_t) done * 2 * sample_bytes) : NULL;
+  ok = ok && bytes != NULL;
+  for (uint32_t i = 0, len = 0; ok && i < done; i++) {
+    for (int c = 0; c < 2; c++) {
+      for (uint32_t k = 0; k < sample_bytes; k++) {
+        bytes[len++] = (unsigned char) (samples[c][i] >> (8 * k));
+      }
+    }
+  }
+  unsigned char digest[16];
+  if (ok) {
+    test_md5(bytes, (size_t) done * 2 * sample_bytes, digest);
+    ok = memcmp(digest, md5, 16) == 0;
+  }
+  free(bytes);
+  free(sub);
+  free(buf);
+  if (!ok) {
+    free(samples[0]);
+    free(samples[1]);
+    samples[0] = samples[1] = NULL;
+    return -1;
+  }
+  *frames = done;
+  return 0;
+}
+
+static int test_report(const char* name, bool passed) {
+  printf("%-48s %s\r\n", name, passed ? "ok" : "FAILED");
+  return passed ? 0 : 1;
+}
+
+/**
+ * One source through the ambisonic bus matches the direct render with the bus's equivalent
+ * filter, and stays close to the direct render with the measured filter of its direction.
+ */
+static int test_ambisonic(void) {
+  const char* input = "outputs/test_ambi_input.wav";
+  const char* bus_path = "outputs/test_ambi_bus.wav";
+  const char* equivalent_path = "outputs/test_ambi_equivalent.wav";
+  const char* direct_path = "outputs/test_ambi_direct.wav";
+  int failures = 0;
+
+  BinauralOptions options;
+  binaural_options_default(&options);
+  options.wisdomPath = NULL;
+  options.progress = false;
+
+  // both channels carry the signal, so the bus's mono downmix is the signal itself
+  char* files[1] = {(char*) input};
+  float azimuth = TEST_DEGREES;
+  static AmbiBus bus;
+  static BinauralFilter equivalent, measured;
+  bool ready = test_write_input(input, 3 * TEST_SAMPLE_RATE / 2, TW_FLOAT32, true) == 0
+      && ambi_bus_init(&bus, AMBI_MAX_ORDER, "dataset_bin") == 0
+      && binaural_load_filter(TEST_DEGREES, &measured) == 0;
+  if (!ready) {
+    return test_report("ambisonic: setup", false);
+  }
+  ambi_bus_filter(&bus, azimuth, &equivalent);
+
+  double max_error = 1, correlation = 0;
+  bool rendered = binaural_compute_ambisonic(1, files, &azimuth, AMBI_MAX_ORDER, bus_path) == 0
+      && test_render(input, equivalent_path, &equivalent, &options) == 0
+      && test_render(input, direct_path, &measured, &options) == 0;
+  failures += test_report("ambisonic: renders", rendered);
+  if (!rendered) {
+    return failures;
+  }
+
+  // the bus sums per channel convolutions, the equivalent filter sums the taps first
+  failures += test_report("ambisonic: bus == equivalent filter",
+      test_compare(bus_path, equivalent_path, &max_error, NULL) == 0 && max_error < 1e-5);
+  // the bus only approximates the measured filter (12 virtual speakers, order 3), so the
+  // direct render is compared on the cue that survives the decode best, the level difference
+  double bus_ild = test_ild(bus_path);
+  double direct_ild = test_ild(direct_path);
+  failures += test_report("ambisonic: ILD close to direct render",
+      test_compare(bus_path, direct_path, &max_error, &correlation) == 0
+      && bus_ild * direct_ild > 0 && fabs(bus_ild - direct_ild) < TEST_AMBI_MAX_ILD_ERROR);
+  printf("  ILD %.1f dB, direct %.1f dB, correlation %.2f\r\n", bus_ild, direct_ild, correlation);
+
+  // mixed sample rates are refused
+  const char* other_rate = "outputs/test_ambi_input_44k.wav";
+  TinyWav tw;
+  bool refused = false;
+  if (tinywav_open_write(&tw, 2, 44100, TW_FLOAT32, TW_SPLIT, other_rate) == 0) {
+    tinywav_close_write(&tw);
+    char* mixed[2] = {(char*) input, (char*) other_rate};
+    float azimuths[2] = {0, 90};
+    refused = binaural_compute_ambisonic(2, mixed, azimuths, 1, bus_path) != 0;
+  }
+  failures += test_report("ambisonic: mixed sample rates refused", refused);
+  return failures;
+}
+
+/**
+ * Rendering twice to one output path, first with the render cache and then without, leaves
+ * the cache entry intact: the output a cache hit linked to it is replaced, not written through.
+ */
+static int test_cache_output_path(void) {
+  // inputs are named relative to the working directory, outputs/ holds the rendered files
+  char* input = "test_cache_input.wav";
+  char output[64];
+  snprintf(output, sizeof(output), "outputs/%d_degrees_%s", TEST_DEGREES, input);
+  const char* first = "outputs/test_cache_first.wav";
+  int failures = 0;
+
+  BinauralOptions options;
+  binaural_options_default(&options);
+  options.wisdomPath = NULL;
+  options.progress = false;
+  options.cacheDir = "outputs/test_cache";
+
+  static BinauralFilter filter;
+  uint64_t key = 0;
+  char entry[128];
+  bool ready = test_write_input(input, TEST_SAMPLE_RATE, TW_FLOAT32, false) == 0
+      && binaural_load_filter(TEST_DEGREES, &filter) == 0;
+  BinauralOptions resolved;
+  binaural_options_resolve(&options, &filter, &resolved); // the settings the render keys on
+  ready = ready && render_cache_key(input, &filter, &resolved, &key) == 0;
+  snprintf(entry, sizeof(entry), "%s/%016llx.wav", options.cacheDir, (unsigned long long) key);
+  remove(entry);
+
+  // a miss that stores the output, then a hit that links it back
+  binaural_compute_ex(TEST_DEGREES, input, &options);
+  ready = ready && test_copy(output, first) == 0;
+  binaural_compute_ex(TEST_DEGREES, input, &options);
+  failures += test_report("cache: hit matches the render", ready && test_same_bytes(output, first) && test_same_bytes(entry, first));
+
+  // new input data under the same name, rendered with the cache off to the same path
+  test_seed += 12345;
+  options.cacheDir = NULL;
+  ready = ready && test_write_input(input, TEST_SAMPLE_RATE, TW_FLOAT32, false) == 0;
+  binaural_compute_ex(TEST_DEGREES, input, &options);
+  failures += test_report("cache: uncached render replaces the output", ready && !test_same_bytes(output, first));
+  failures += test_report("cache: entry left intact", ready && test_same_bytes(entry, first));
+
+  // above digital silence the skipped blocks depend on the block size, for every kernel
+  BinauralOptions small = resolved, large = resolved;
+  small.silenceThreshold = large.silenceThreshold = 0.01f;
+  small.blockSize = 256;
+  large.blockSize = 512;
+  uint64_t small_key = 0, large_key = 0;
+  failures += test_report("cache: key covers the block size when skipping",
+      render_cache_key(input, &filter, &small, &small_key) == 0
+      && render_cache_key(input, &filter, &large, &large_key) == 0 && small_key != large_key);
+  remove(input);
+  return failures;
+}
+
+/**
+ * Shards rendered separately and stitched are byte-identical to a single render, also with
+ * silence skipping above digital silence: the input holds blocks that start loud and end
+ * quiet, so a shard's pre-roll is quiet while the block before it was not.
+ */
+static int test_shards(void) {
+  char* input = "test_shard_input.wav";
+  char output[64];
+  snprintf(output, sizeof(output), "outputs/%d_degrees_%s", TEST_DEGREES, input);
+  const char* single = "outputs/test_shard_single.wav";
+  const uint32_t block = 1024, shards = 4;
+  const uint32_t frames = 8 * block + 300;
+  const BinauralKernel kernels[3] = {BINAURAL_KERNEL_DIRECT, BINAURAL_KERNEL_FFT, BINAURAL_KERNEL_Q15};
+  const char* names[3] = {"shards: direct == single render", "shards: fft == single render", "shards: q15 == single render"};
+  int failures = 0;
+
+  for (int k = 0; k < 3; k++) {
+    TinyWavSampleFormat format = kernels[k] == BINAURAL_KERNEL_Q15 ? TW_INT16 : TW_FLOAT32;
+    bool ready = test_write_quiet_input(input, frames, block, format) == 0;
+
+    BinauralOptions options;
+    binaural_options_default(&options);
+    options.wisdomPath = NULL;
+    options.progress = false;
+    options.kernel = kernels[k];
+    options.blockSize = block;
+    options.silenceThreshold = TEST_QUIET_THRESHOLD;
+    if (kernels[k] == BINAURAL_KERNEL_Q15) {
+      options.outputFormat = TW_INT16;
+    }
+
+    binaural_compute_ex(TEST_DEGREES, input, &options);
+    ready = ready && test_copy(output, single) == 0;
+    for (uint32_t shard = 0; shard < shards && ready; shard++) {
+      ready = binaural_compute_shard(TEST_DEGREES, input, shard, shards, &options) == 0;
+    }
+    ready = ready && binaural_stitch_shards(TEST_DEGREES, input, shards, &options) == 0;
+    failures += test_report(names[k], ready && test_same_bytes(output, single));
+  }
+  remove(input);
+  return failures;
+}
+
+/**
+ * Every clip of a batch renders to the same bytes as the clip rendered alone: float clips
+ * packed into the shared buffers, and int16 clips with the Q15 kernel, which render alone.
+ */
+static int test_batch(void) {
+  char* inputs[3] = {"test_batch_a.wav", "test_batch_b.wav", "test_batch_c.wav"};
+  const uint32_t frames[3] = {5000, 12000, 7000};
+  const TinyWavSampleFormat formats[3] = {TW_FLOAT32, TW_INT16, TW_FLOAT32};
+  const uint32_t block = 1024;
+  const BinauralKernel kernels[3] = {BINAURAL_KERNEL_DIRECT, BINAURAL_KERNEL_Q15, BINAURAL_KERNEL_DIRECT};
+  const float thresholds[3] = {0, 0, TEST_QUIET_THRESHOLD};
+  const char* names[3] = {"batch: direct == clips rendered alone", "batch: q15 == clips rendered alone",
+      "batch: skipping above silence == alone"};
+  int failures = 0;
+
+  for (int k = 0; k < 3; k++) {
+    // noise bursts and digital silence, or blocks that open loud and end quiet when skipping
+    bool ready = true;
+    for (int i = 0; i < 3; i++) {
+      ready = ready && (thresholds[k] > 0 ? test_write_quiet_input(inputs[i], frames[i], block, formats[i])
+          : test_write_input(inputs[i], frames[i], formats[i], false)) == 0;
+    }
+    BinauralOptions options;
+    binaural_options_default(&options);
+    options.wisdomPath = NULL;
+    options.progress = false;
+    options.kernel = kernels[k];
+    options.blockSize = block;
+    options.silenceThreshold = thresholds[k];
+
+    char outputs[3][64], batched[3][64];
+    bool same = ready && binaural_compute_batch(TEST_DEGREES, inputs, 3, &options) == 0;
+    for (int i = 0; i < 3 && same; i++) {
+      snprintf(outputs[i], sizeof(outputs[i]), "outputs/%d_degrees_%s", TEST_DEGREES, inputs[i]);
+      snprintf(batched[i], sizeof(batched[i]), "outputs/batched_%s", inputs[i]);
+      same = test_copy(outputs[i], batched[i]) == 0;
+    }
+    for (int i = 0; i < 3 && same; i++) {
+      binaural_compute_ex(TEST_DEGREES, inputs[i], &options);
+      same = test_same_bytes(outputs[i], batched[i]);
+    }
+    failures += test_report(names[k], same);
+  }
+  for (int i = 0; i < 3; i++) {
+    remove(inputs[i]);
+  }
+  return failures;
+}
+
+/**
+ * conv_dispatch() gives the same bits as conv_32_delay() for specialised, padded and generic
+ * tap counts and block lengths, whatever the compiler flags of this build.
+ */
+static int test_conv_kernels(void) {
+  const uint32_t taps[5] = {128, 256, 100, 67, 255};
+  const uint32_t lens[5] = {64, 512, 4096, 1000, 33};
+  static float filter[FILTER_SIZE];
+  static float audio[FILTER_SIZE - 1 + 4096], expected[FILTER_SIZE - 1 + 4096], output[FILTER_SIZE - 1 + 4096];
+  for (uint32_t i = 0; i < FILTER_SIZE - 1 + 4096; i++) {
+    audio[i] = test_noise();
+  }
+  int differ = 0;
+  for (int t = 0; t < 5; t++) {
+    // zero past the taps, as in a BinauralFilter, which the shorter ones are padded with
+    for (uint32_t j = 0; j < FILTER_SIZE; j++) {
+      filter[j] = j < taps[t] ? test_noise() : 0.0f;
+    }
+    for (int l = 0; l < 5; l++) {
+      uint32_t delay = FILTER_SIZE - taps[t] < 7 ? FILTER_SIZE - taps[t] : 7;
+      memset(expected, 0, sizeof(expected));
+      memset(output, 0, sizeof(output));
+      conv_32_delay(filter, taps[t], delay, audio, expected, FILTER_SIZE - 1, lens[l]);
+      conv_dispatch(filter, taps[t], delay, audio, output, FILTER_SIZE - 1, lens[l]);
+      differ += memcmp(expected, output, sizeof(output)) != 0;
+    }
+  }
+  if (differ > 0) {
+    printf("  %d of 25 tap counts and lengths differ\r\n", differ);
+  }
+  return test_report("kernels: dispatch == conv_32_delay", differ == 0);
+}
+
+/** The fixed-point render of an int16 input stays within BINAURAL_Q15_MIN_SNR of the float render */
+static int test_q15_accuracy(void) {
+  char* input = "test_q15_input.wav";
+  char output[64];
+  snprintf(output, sizeof(output), "outputs/%d_degrees_%s", TEST_DEGREES, input);
+  const char* float_path = "outputs/test_q15_float.wav";
+
+  BinauralOptions options;
+  binaural_options_default(&options);
+  options.wisdomPath = NULL;
+  options.progress = false;
+
+  bool ready = test_write_input(input, TEST_SAMPLE_RATE, TW_INT16, false) == 0;
+  binaural_compute_ex(TEST_DEGREES, input, &options);
+  ready = ready && test_copy(output, float_path) == 0;
+  options.kernel = BINAURAL_KERNEL_Q15;
+  binaural_compute_ex(TEST_DEGREES, input, &options);
+
+  double max_error = 0;
+  double snr = ready ? test_snr(float_path, output, &max_error) : -INFINITY;
+  printf("  SNR %.1f dB, max error %.2f LSB\r\n", snr, max_error);
+  remove(input);
+  return test_report("q15: SNR against the float render", snr >= BINAURAL_Q15_MIN_SNR);
+}
+
+/**
+ * The autotune wisdom fills in only the settings left on auto: an explicit block size, kernel
+ * and FFT size are kept, whatever the wisdom picked for the filter.
+ */
+static int test_wisdom_explicit(void) {
+  const char* wisdom = "outputs/test_wisdom.txt";
+  FILE* f = fopen(wisdom, "w");
+  if (f == NULL) {
+    return test_report("wisdom: setup", false);
+  }
+  fprintf(f, "%d %d fft 64 1024 1.000\n", FILTER_SIZE, MAX_CONVOLVE_BLOCK_SIZE);
+  fclose(f);
+
+  static BinauralFilter filter;
+  for (int c = 0; c < 2; c++) {
+    filter.len[c] = FILTER_SIZE;
+  }
+  BinauralOptions options, resolved;
+  binaural_options_default(&options);
+  options.wisdomPath = wisdom;
+  binaural_options_resolve(&options, &filter, &resolved);
+  int failures = test_report("wisdom: fills in the auto settings",
+      resolved.kernel == BINAURAL_KERNEL_FFT && resolved.blockSize == 64 && resolved.fftSize == 1024);
+
+  options.kernel = BINAURAL_KERNEL_DIRECT;
+  options.blockSize = 1024;
+  binaural_options_resolve(&options, &filter, &resolved);
+  failures += test_report("wisdom: explicit settings win",
+      resolved.kernel == BINAURAL_KERNEL_DIRECT && resolved.blockSize == 1024);
+
+  // an explicit block size gets an FFT that fits it, not the one measured for the wisdom's
+  options.kernel = BINAURAL_KERNEL_FFT;
+  options.blockSize = 512;
+  binaural_options_resolve(&options, &filter, &resolved);
+  failures += test_report("wisdom: FFT size fits an explicit block size",
+      resolved.kernel == BINAURAL_KERNEL_FFT && resolved.blockSize == 512 && resolved.fftSize >= 512 + FILTER_SIZE - 1);
+  remove(wisdom);
+  return failures;
+}
+
+/**
+ * A time range renders to the very samples of the same range cut from a render of the whole
+ * input, with the direct and the Q15 kernel, for a range off the block grid.
+ */
+static int test_range(void) {
+  char* input = "test_range_input.wav";
+  const uint32_t start = 10007, end = 30011;
+  char whole[64], part[64];
+  snprintf(whole, sizeof(whole), "outputs/%d_degrees_%s", TEST_DEGREES, input);
+  snprintf(part, sizeof(part), "outputs/%d_degrees_%u-%u_%s", TEST_DEGREES, start, end, input);
+  const BinauralKernel kernels[2] = {BINAURAL_KERNEL_DIRECT, BINAURAL_KERNEL_Q15};
+  const char* names[2] = {"range: direct == cut of whole render", "range: q15 == cut of whole render"};
+  int failures = 0;
+
+  for (int k = 0; k < 2; k++) {
+    TinyWavSampleFormat format = kernels[k] == BINAURAL_KERNEL_Q15 ? TW_INT16 : TW_FLOAT32;
+    bool ready = test_write_input(input, TEST_SAMPLE_RATE, format, false) == 0;
+    BinauralOptions options;
+    binaural_options_default(&options);
+    options.wisdomPath = NULL;
+    options.progress = false;
+    options.kernel = kernels[k];
+    binaural_compute_ex(TEST_DEGREES, input, &options);
+    options.startFrame = start;
+    options.endFrame = end;
+    remove(part);
+    binaural_compute_ex(TEST_DEGREES, input, &options);
+    failures += test_report(names[k], ready && test_same_frames(whole, start, part));
+  }
+  remove(input);
+  return failures;
+}
+
+/**
+ * A render from a database whose filters are far longer than the stack could hold (2M taps)
+ * matches the direct render of the first FILTER_SIZE taps of the measurement it picks.
+ */
+static int test_hrir_db_long_filter(void) {
+  const char* db_path = "outputs/test_long.hrdb";
+  char* input = "test_db_input.wav";
+  char output[64];
+  snprintf(output, sizeof(output), "outputs/0_0_degrees_%s", input);
+  const char* direct_path = "outputs/test_db_direct.wav";
+  const uint32_t filter_size = 2u << 20;
+
+  // two measurements on the horizon, no triangulation, one grid cell; the file is sparse
+  // past the taps that are written
+  HrirDbHeader h = {{'H', 'R', 'D', 'B'}, HRIR_DB_VERSION, 2, 0, filter_size, 2, TEST_SAMPLE_RATE, 1, 1,
+      64, 104, 104, 112, 4096};
+  HrirDbPosition positions[2] = {{0, 0, 1, 0, 0}, {90, 0, 0, 1, 0}};
+  uint32_t vertex_triangles[2] = {HRIR_DB_NONE, HRIR_DB_NONE};
+  uint32_t grid[1] = {0};
+  static BinauralFilter filter;
+  FILE* f = fopen(db_path, "wb");
+  bool ready = f != NULL;
+  if (ready) {
+    fwrite(&h, sizeof(h), 1, f);
+    fseek(f, h.PositionsOffset, SEEK_SET);
+    fwrite(positions, sizeof(positions), 1, f);
+    fseek(f, h.VertexTrianglesOffset, SEEK_SET);
+    fwrite(vertex_triangles, sizeof(vertex_triangles), 1, f);
+    fseek(f, h.GridOffset, SEEK_SET);
+    fwrite(grid, sizeof(grid), 1, f);
+    for (uint32_t c = 0; c < 2; c++) {
+      for (uint32_t j = 0; j < FILTER_SIZE; j++) {
+        filter.taps[c][j] = test_noise() * 0.1f;
+      }
+      filter.len[c] = FILTER_SIZE;
+      fseek(f, (long) (h.FiltersOffset + (uint64_t) c * filter_size * sizeof(float)), SEEK_SET);
+      fwrite(filter.taps[c], sizeof(float), FILTER_SIZE, f);
+    }
+    // the end of the last filter, so the file has its full length
+    float zero = 0;
+    fseek(f, (long) (h.FiltersOffset + (uint64_t) 4 * filter_size * sizeof(float) - sizeof(float)), SEEK_SET);
+    fwrite(&zero, sizeof(float), 1, f);
+    fclose(f);
+  }
+
+  BinauralOptions options;
+  binaural_options_default(&options);
+  options.wisdomPath = NULL;
+  options.progress = false;
+  remove(output);
+  ready = ready && test_write_input(input, TEST_SAMPLE_RATE / 2, TW_FLOAT32, false) == 0
+      && test_render(input, direct_path, &filter, &options) == 0;
+  binaural_compute_db(db_path, 0, 0, input);
+  int failures = test_report("hrir_db: 2M tap filters render", ready && test_same_bytes(output, direct_path));
+  remove(input);
+  remove(db_path);
+  return failures;
+}
+
+/**
+ * A TW_FLAC24 render decodes, frame CRCs and STREAMINFO MD5 included, to the float render
+ * quantised to 24 bits as flac_writer_write() quantises it, with one encoder thread and with
+ * several.
+ */
+static int test_flac(void) {
+  char* input = "test_flac_input.wav";
+  char float_path[64], flac_path[64];
+  snprintf(float_path, sizeof(float_path), "outputs/%d_degrees_%s", TEST_DEGREES, input);
+  snprintf(flac_path, sizeof(flac_path), "outputs/%d_degrees_test_flac_input.flac", TEST_DEGREES);
+  const uint32_t frames = 150001; // batches of several threads' frames, the last frame short
+  const uint32_t threads[2] = {1, 4};
+  const char* names[2] = {"flac: 1 encoder thread == 24-bit render", "flac: 4 encoder threads == 24-bit render"};
+
+  BinauralOptions options;
+  binaural_options_default(&options);
+  options.wisdomPath = NULL;
+  options.progress = false;
+  bool ready = test_write_flac_input(input, frames) == 0;
+  binaural_compute_ex(TEST_DEGREES, input, &options);
+
+  TinyWav tw;
+  int32_t* expected[2] = {NULL, NULL};
+  uint32_t expected_frames = 0;
+  ready = ready && tinywav_open_read(&tw, float_path, TW_SPLIT) == 0;
+  if (ready) {
+    expected_frames = (uint32_t) tw.numFramesInHeader;
+    expected[0] = (int32_t *) malloc((size_t) expected_frames * sizeof(int32_t));
+    expected[1] = (int32_t *) malloc((size_t) expected_frames * sizeof(int32_t));
+    ready = expected[0] != NULL && expected[1] != NULL;
+    float x[2][CONVOLVE_BLOCK_SIZE];
+    float* ptrs[2] = {x[0], x[1]};
+    uint32_t done = 0;
+    int n;
+    while (ready && (n = tinywav_read_f(&tw, ptrs, CONVOLVE_BLOCK_SIZE)) > 0 && done + (uint32_t) n <= expected_frames) {
+      for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < n; i++) {
+          long v = lrintf(x[c][i] * 8388607.0f);
+          expected[c][done + i] = (int32_t) (v > 8388607 ? 8388607 : v < -8388608 ? -8388608 : v);
+        }
+      }
+      done += (uint32_t) n;
+    }
+    ready = ready && done == expected_frames && done > 0;
+    tinywav_close_read(&tw);
+  }
+
+  int failures = 0;
+  for (int t = 0; t < 2; t++) {
+    options.outputFormat = TW_FLAC24;
+    options.encoderThreads = threads[t];
+    remove(flac_path);
+    binaural_compute_ex(TEST_DEGREES, input, &options);
+    int32_t* decoded[2];
+    uint32_t decoded_frames = 0;
+    bool same = ready && test_flac_decode(flac_path, decoded, &decoded_frames) == 0;
+    same = same && decoded_frames == expected_frames
+        && memcmp(decoded[0], expected[0], (size_t) expected_frames * sizeof(int32_t)) == 0
+        && memcmp(decoded[1], expected[1], (size_t) expected_frames * sizeof(int32_t)) == 0;
+    if (ready && decoded_frames > 0) {
+      free(decoded[0]);
+      free(decoded[1]);
+    }
+    failures += test_report(names[t], same);
+  }
+  free(expected[0]);
+  free(expected[1]);
+  remove(input);
+  return failures;
+}
+
+int main(void) {
+  int failures = 0;
+  failures += test_conv_kernels();
+  failures += test_q15_accuracy();
+  failures += test_wisdom_explicit();
+  failures += test_hrir_db_long_filter();
+  failures += test_ambisonic();
+  failures += test_cache_output_path();
+  failures += test_range();
+  failures += test_flac();
+  failures += test_shards();
+  failures += test_batch();
+  printf("%d failed\r\n", failures);
+  return failures;
+}
@@ -17,6 +17,10 @@
  * by Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
  */
 
+#if !_WIN32 && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64 // 64-bit off_t for fseeko on 32-bit targets
+#endif
+
 #include <string.h> // for memcpy
 #if _WIN32
 #include <malloc.h> // for alloca
@@ -24,8 +28,22 @@
 #include <alloca.h>
 #endif
 #include "tinywav.h"
+#include "hrir_db.h"
+#include "fft_conv.h"
+#include "autotune.h"
+#include "conv_kernels.h"
+#include "flac_writer.h"
+#include "fixed_conv.h"
+#include "render_cache.h"
+#include "ring_buffer.h"
+#include "ambisonics.h"
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h> // for atoi
+#if defined(__linux__)
+#include <fcntl.h> // for posix_fadvise
+#include <unistd.h>
+#endif
 
 /** @returns true if the chunk of 4 characters matches the supplied string */
 static bool chunkIDMatches(char chunk[4], const char* chunkName)
@@ -60,8 +78,27 @@ int tinywav_open_write(TinyWav *tw, int16_t numChannels, int32_t samplerate, Tin
   tw->numChannels = numChannels;
   tw->numFramesInHeader = -1; // not used for writer
   tw->totalFramesReadWritten = 0;
+  tw->dataOffset = -1;
   tw->sampFmt = sampFmt;
   tw->chanFmt = chanFmt;
+  tw->flac = NULL;
+
+  if (sampFmt == TW_FLAC24) {
+    // no wav header, the encoder writes the FLAC stream header itself
+    memset(&tw->h, 0, sizeof(TinyWavHeader));
+    tw->h.NumChannels = numChannels;
+    tw->h.SampleRate = samplerate;
+    tw->h.BitsPerSample = 24;
+    tw->flac = (FlacWriter *) malloc(sizeof(FlacWriter));
+    if (tw->flac == NULL || flac_writer_open(tw->flac, tw->f, numChannels, samplerate, 24) != 0) {
+      free(tw->flac);
+      tw->flac = NULL;
+      fclose(tw->f);
+      tw->f = NULL;
+      return -1;
+    }
+    return 0;
+  }
 
   // prepare WAV header
   /**@note: We do this byte-by-byte to avoid dependencies (htonl() et al.) and because struct padding depends on
@@ -113,6 +150,13 @@ int tinywav_open_write(TinyWav *tw, int16_t numChannels, int32_t samplerate, Tin
   return 0;
 }
 
+int tinywav_set_encoder_threads(TinyWav *tw, uint32_t threads) {
+  if (tw == NULL || tw->flac == NULL) {
+    return 0;
+  }
+  return flac_writer_set_threads(tw->flac, threads);
+}
+
 int tinywav_open_read(TinyWav *tw, const char *path, TinyWavChannelFormat chanFmt) {
   
   if (tw == NULL || path == NULL) {
@@ -130,7 +174,17 @@ int tinywav_open_read(TinyWav *tw, const char *path, TinyWavChannelFormat chanFm
     perror("[tinywav] Failed to open file for reading");
     return -1;
   }
-  
+
+  return tinywav_open_read_stream(tw, tw->f, chanFmt);
+}
+
+int tinywav_open_read_stream(TinyWav *tw, FILE *f, TinyWavChannelFormat chanFmt) {
+
+  if (tw == NULL || f == NULL) {
+    return -1;
+  }
+  tw->f = f;
+
   // Parse WAV header
   /** @note: We do this byte-by-byte to avoid dependencies (htonl() et al.) and because struct padding depends on
    *  specific compiler implementation ('slurping' directly into the header struct is therefore dangerous).
@@ -192,10 +246,35 @@ int tinywav_open_read(TinyWav *tw, const char *path, TinyWavChannelFormat chanFm
 
   tw->numFramesInHeader = tw->h.Subchunk2Size / (tw->numChannels * tw->sampFmt);
   tw->totalFramesReadWritten = 0;
+  tw->dataOffset = ftell(tw->f);
+  tw->flac = NULL;
   
   return 0;
 }
 
+/** fseek() to an absolute 64-bit position; long is 32 bits on Windows, too short past 2 GB */
+static int tinywav_fseek64(FILE *f, int64_t position) {
+#if _WIN32
+  return _fseeki64(f, position, SEEK_SET);
+#else
+  return fseeko(f, (off_t) position, SEEK_SET);
+#endif
+}
+
+int tinywav_seek(TinyWav *tw, uint32_t frame) {
+
+  if (tw == NULL || !tinywav_isOpen(tw) || tw->dataOffset < 0 || frame > (uint32_t) tw->numFramesInHeader) {
+    return -1;
+  }
+
+  if (tinywav_fseek64(tw->f, (int64_t) tw->dataOffset + (int64_t) frame * tw->numChannels * tw->sampFmt) != 0) {
+    return -1;
+  }
+  tw->totalFramesReadWritten = frame;
+
+  return 0;
+}
+
 int tinywav_read_f(TinyWav *tw, void *data, int len) {
   
   if (tw == NULL || data == NULL || len < 0 || !tinywav_isOpen(tw)) {
@@ -273,6 +352,47 @@ int tinywav_read_f(TinyWav *tw, void *data, int len) {
   }
 }
 
+int tinywav_read_i16(TinyWav *tw, void *data, int len) {
+  
+  if (tw == NULL || data == NULL || len < 0 || !tinywav_isOpen(tw) || tw->sampFmt != TW_INT16) {
+    return -1;
+  }
+  
+  if (tw->totalFramesReadWritten * tw->h.BlockAlign >= tw->h.Subchunk2Size) {
+    return 0; // past the 'data' subchunk, not an error
+  }
+  
+  if (tw->chanFmt == TW_INTERLEAVED) {
+    size_t samples_read = fread(data, sizeof(int16_t), tw->numChannels*len, tw->f);
+    tw->totalFramesReadWritten += samples_read / tw->numChannels;
+    return (int) samples_read / tw->numChannels;
+  }
+  
+  int16_t *interleaved_data = (int16_t *) alloca(tw->numChannels*len*sizeof(int16_t));
+  size_t samples_read = fread(interleaved_data, sizeof(int16_t), tw->numChannels*len, tw->f);
+  tw->totalFramesReadWritten += samples_read / tw->numChannels;
+  int frames_read = (int) samples_read / tw->numChannels;
+  switch (tw->chanFmt) {
+    case TW_INLINE: { // channel buffer is inlined e.g. [LLLLRRRR]
+      for (int i = 0, pos = 0; i < tw->numChannels; i++) {
+        for (int j = i; j < frames_read * tw->numChannels; j += tw->numChannels, ++pos) {
+          ((int16_t *) data)[pos] = interleaved_data[j];
+        }
+      }
+      return frames_read;
+    }
+    case TW_SPLIT: { // channel buffer is split e.g. [[LLLL],[RRRR]]
+      for (int i = 0; i < tw->numChannels; i++) {
+        for (int j = 0; j < frames_read; j++) {
+          ((int16_t **) data)[i][j] = interleaved_data[j*tw->numChannels + i];
+        }
+      }
+      return frames_read;
+    }
+    default: return 0;
+  }
+}
+
 void tinywav_close_read(TinyWav *tw) {
   if (tw->f == NULL) {
     return; // fclose(NULL) is undefined behaviour
@@ -292,6 +412,24 @@ int tinywav_write_f(TinyWav *tw, void *f, int len) {
   // 2. write to disk
   
   switch (tw->sampFmt) {
+    case TW_FLAC24: {
+      // the encoder reads the channels in place, whatever their layout
+      const float *x[FLAC_MAX_CHANNELS];
+      int stride = 1;
+      for (int j = 0; j < tw->numChannels; ++j) {
+        switch (tw->chanFmt) {
+          case TW_INTERLEAVED: x[j] = (const float *) f + j; stride = tw->numChannels; break;
+          case TW_INLINE: x[j] = (const float *) f + j*len; break;
+          case TW_SPLIT: x[j] = ((const float **) f)[j]; break;
+          default: return 0;
+        }
+      }
+      int frames_written = flac_writer_write(tw->flac, x, stride, len);
+      if (frames_written > 0) {
+        tw->totalFramesReadWritten += frames_written;
+      }
+      return frames_written;
+    }
     case TW_INT16: {
       int16_t *z = (int16_t *) alloca(tw->numChannels*len*sizeof(int16_t));
       switch (tw->chanFmt) {
@@ -368,10 +506,42 @@ int tinywav_write_f(TinyWav *tw, void *f, int len) {
   }
 }
 
+int tinywav_write_i16(TinyWav *tw, void *f, int len) {
+  
+  if (tw == NULL || f == NULL || len < 0 || !tinywav_isOpen(tw) || tw->sampFmt != TW_INT16) {
+    return -1;
+  }
+  
+  const int16_t *z = (const int16_t *) f;
+  if (tw->chanFmt != TW_INTERLEAVED) {
+    int16_t *interleaved = (int16_t *) alloca(tw->numChannels*len*sizeof(int16_t));
+    for (int i = 0, k = 0; i < len; ++i) {
+      for (int j = 0; j < tw->numChannels; ++j) {
+        interleaved[k++] = tw->chanFmt == TW_SPLIT ? ((const int16_t **) f)[j][i] : z[j*len+i];
+      }
+    }
+    z = interleaved;
+  }
+  
+  size_t samples_written = fwrite(z, sizeof(int16_t), tw->numChannels*len, tw->f);
+  size_t frames_written = samples_written / tw->numChannels;
+  tw->totalFramesReadWritten += frames_written;
+  return (int) frames_written;
+}
+
 void tinywav_close_write(TinyWav *tw) {
   if (tw == NULL || tw->f == NULL) {
     return; // fclose(NULL) is undefined behaviour
   }
+
+  if (tw->flac != NULL) {
+    flac_writer_close(tw->flac); // completes the stream header
+    free(tw->flac);
+    tw->flac = NULL;
+    fclose(tw->f);
+    tw->f = NULL;
+    return;
+  }
   
   uint32_t data_len = tw->totalFramesReadWritten * tw->numChannels * tw->sampFmt;
   uint32_t chunkSize_len = 36 + data_len; // 36 is size of header minus 8 (RIFF + this field)
@@ -403,8 +573,6 @@ bool tinywav_isOpen(TinyWav *tw) {
 #define NUM_CHANNELS 2
 #define SAMPLE_RATE 48000
 #define BLOCK_SIZE 512
-#define FILTER_SIZE 256
-#define CONVOLVE_BLOCK_SIZE 512
 
 void copy_array_f(float* dest, float* src, int dest_offset, int src_offset, int length) {
 	for(int i = 0; i < length; i++) {
@@ -421,6 +589,76 @@ void conv_32(float* filter, float* audio, float* output, uint32_t start, uint32_
   }
 }
 
+CONV_EXACT_BEGIN
+void conv_32_delay(float* filter, uint32_t taps, uint32_t delay, float* audio, float* output, uint32_t start, uint32_t len) {
+  // the delay is only an offset into the sample history, no taps are spent on it
+  float* delayed = audio - delay;
+  for(uint32_t i = start; i < len + start; i++) {
+    float acc = 0;
+    for(uint32_t j = 0; j < taps; j++) {
+      acc += filter[j] * delayed[i - j];
+    }
+    output[i] = acc;
+  }
+}
+CONV_EXACT_END
+
+int binaural_load_filter(int snap_deg, BinauralFilter* filter) {
+
+	char filter_path[64];
+	FILE* f_file;
+	memset(filter, 0, sizeof(BinauralFilter)); // taps past the length stay zero
+
+	// delay + minimum-phase split from utils_python/trim_hrir.py
+	snprintf(filter_path, sizeof(filter_path), "dataset_bin/%d_degrees.min.bin", snap_deg);
+	f_file = fopen(filter_path, "rb");
+	if (f_file != NULL) {
+		uint32_t header[4]; // delay_l, taps_l, delay_r, taps_r
+		int ok = fread(header, sizeof(uint32_t), 4, f_file) == 4;
+		for (int c = 0; ok && c < 2; c++) {
+			filter->delay[c] = header[2 * c];
+			filter->len[c] = header[2 * c + 1];
+			ok = filter->len[c] > 0 && filter->delay[c] + filter->len[c] <= FILTER_SIZE;
+		}
+		for (int c = 0; ok && c < 2; c++) {
+			ok = fread(filter->taps[c], sizeof(float), filter->len[c], f_file) == filter->len[c];
+		}
+		fclose(f_file);
+		if (ok) {
+			printf("filter path: %s (delay %u/%u, taps %u/%u)\r\n", filter_path,
+			    filter->delay[0], filter->delay[1], filter->len[0], filter->len[1]);
+			return 0;
+		}
+		printf("[binaural] Ignoring malformed %s\r\n", filter_path);
+	}
+
+	snprintf(filter_path, sizeof(filter_path), "dataset_bin/%d_degrees.bin", snap_deg);
+	printf("filter path: %s \r\n", filter_path);
+	f_file = fopen(filter_path, "rb");
+	if (f_file == NULL) {
+		perror("[binaural] Failed to open filter");
+		return -1;
+	}
+	// the filter length is taken from the file (256 samples each channel for the given filters),
+	// anything up to FILTER_SIZE is convolved by the kernel matching that length
+	fseek(f_file, 0, SEEK_END);
+	uint32_t len = (uint32_t) (ftell(f_file) / (2 * sizeof(float)));
+	fseek(f_file, 0, SEEK_SET);
+	if (len < 1 || len > FILTER_SIZE) {
+		printf("[binaural] %s has %u taps per channel, at most %d are supported\r\n", filter_path, len, FILTER_SIZE);
+		fclose(f_file);
+		return -1;
+	}
+	size_t taps = fread(filter->taps[0], sizeof(float), len, f_file);
+	taps += fread(filter->taps[1], sizeof(float), len, f_file);
+	fclose(f_file);
+	for (int c = 0; c < 2; c++) {
+		filter->len[c] = len;
+		filter->delay[c] = 0;
+	}
+	return taps == 2 * len ? 0 : -1;
+}
+
 void binaural_compute_no_ptrs(int degrees, char* audio_file) {
 
 	// get snapped angle that is multiple of 30 degrees
@@ -580,167 +818,933 @@ void binaural_compute_no_ptrs(int degrees, char* audio_file) {
 	tinywav_close_read(&tw);
 }
 
-void binaural_compute(int degrees, char* audio_file) {
-
-	// get snapped angle that is multiple of 30 degrees
-	int snap_seg = (int) round(((float) degrees) / 30);
-	int snap_deg = snap_seg * 30;
-  snap_deg = snap_deg % 360;
-
-  printf("snap_deg: %d, degrees: %d\r\n", snap_deg, degrees);
-	// convert degrees to char
-	
-  char char_snap_deg[8] = "";
-	char char_degrees[8] = "";
-	sprintf(char_snap_deg, "%d", snap_deg);
-	sprintf(char_degrees, "%d", degrees);
-
-  printf("snap_deg: %s, degrees: %s\r\n", char_snap_deg, char_degrees);
-  // build filter file path
-	char filter_path[64] = "";
-  strcat(filter_path, "dataset_bin/");
-	strcat(filter_path, char_snap_deg);
-	strcat(filter_path, "_");
-	strcat(filter_path, "degrees.bin");
-
-	// build output file path
-	char output_path[64] = "";
-	strcat(output_path, "outputs/");
-	strcat(output_path, char_degrees);
-	strcat(output_path, "_");
-	strcat(output_path, "degrees_");
-	strcat(output_path, audio_file);
-
-	FILE* f_file;
-	uint32_t byteCheck;
+void binaural_options_default(BinauralOptions* options) {
+	options->silenceThreshold = 0.0f;
+	options->blockSize = 0;
+	options->kernel = BINAURAL_KERNEL_AUTO;
+	options->fftSize = 0;
+	options->wisdomPath = BINAURAL_WISDOM_FILE;
+	options->maxLatency = MAX_CONVOLVE_BLOCK_SIZE;
+	options->progress = true;
+	options->cacheDir = NULL;
+	options->cacheMaxBytes = RENDER_CACHE_MAX_BYTES;
+	options->startFrame = 0;
+	options->endFrame = UINT32_MAX;
+	options->outputFormat = TW_FLOAT32;
+	options->encoderThreads = 1;
+}
 
-	printf("filter path: %s \r\n", filter_path);
-	printf("output path: %s \r\n", output_path);
-	// load filter's LR channels
-	f_file = fopen(filter_path, "rb");
+void binaural_options_resolve(const BinauralOptions* options, const BinauralFilter* filter, BinauralOptions* resolved) {
+	*resolved = *options;
+	uint32_t span = 0;
+	for (int c = 0; c < NUM_CHANNELS; ++c) {
+		span = filter->delay[c] + filter->len[c] > span ? filter->delay[c] + filter->len[c] : span;
+	}
+	// the wisdom only fills in what the caller left on auto, and only ranks the float kernels
+	BinauralOptions tuned = *options;
+	if (options->kernel != BINAURAL_KERNEL_Q15 && binaural_wisdom_apply(&tuned, span) == 0) {
+		if (options->kernel == BINAURAL_KERNEL_AUTO) {
+			resolved->kernel = tuned.kernel;
+		}
+		if (options->blockSize == 0) {
+			resolved->blockSize = tuned.blockSize;
+		}
+		if (options->fftSize == 0 && resolved->kernel == tuned.kernel && resolved->blockSize == tuned.blockSize) {
+			resolved->fftSize = tuned.fftSize;
+		}
+	}
+	resolved->wisdomPath = NULL;
+	if (resolved->kernel == BINAURAL_KERNEL_AUTO) {
+		resolved->kernel = BINAURAL_KERNEL_DIRECT;
+	}
+	if (resolved->blockSize < 1 || resolved->blockSize > MAX_CONVOLVE_BLOCK_SIZE) {
+		resolved->blockSize = CONVOLVE_BLOCK_SIZE;
+	}
+	if (resolved->kernel == BINAURAL_KERNEL_FFT && resolved->fftSize < fft_conv_min_size(resolved->blockSize)) {
+		resolved->fftSize = fft_conv_min_size(resolved->blockSize);
+	}
+}
 
-	static float filter_l[256];  // given filters have 256 samples each channel
-	static float filter_r[256];
-	fread(filter_l, 4, 256, f_file);
-	fread(filter_r, 4, 256, f_file);
-	fclose(f_file);
+/** @returns the largest sample magnitude over all channels of a block */
+static float block_peak(float** channels, uint32_t len) {
+	float peak = 0.0f;
+	for (int c = 0; c < NUM_CHANNELS; ++c) {
+		for (uint32_t i = 0; i < len; i++) {
+			float a = fabsf(channels[c][i]);
+			peak = a > peak ? a : peak;
+		}
+	}
+	return peak;
+}
 
-  for(int i = 0; i < 256; i++) {
-    printf("filter_l[%d]: %f, filter_r[%d]: %f\r\n", i, filter_l[i], i, filter_r[i]);
-  }
+/** @returns the largest sample magnitude over all channels of a block of int16 samples */
+static int32_t block_peak_i16(int16_t** channels, uint32_t len) {
+	int32_t peak = 0;
+	for (int c = 0; c < NUM_CHANNELS; ++c) {
+		for (uint32_t i = 0; i < len; i++) {
+			int32_t a = channels[c][i] < 0 ? -(int32_t) channels[c][i] : channels[c][i];
+			peak = a > peak ? a : peak;
+		}
+	}
+	return peak;
+}
 
-	// setup for audio file comprehension and format
-	static TinyWav tw; // address to store read audio file
-	uint32_t sample_rate;
+/**
+ * The silent frames leading up to frame `start`, counted in whole blocks of block_size that end
+ * at `start`, the way a render from an earlier block boundary reaches it. A render of a range
+ * (or a shard) then skips the very blocks a single render does. Counting stops once the filter
+ * history is covered; the silence before the start of the input counts as well. Silence is
+ * compared in int16 units for binaural_render_q15() (fixed), else as float.
+ */
+static uint32_t quiet_history(TinyWav *tw, uint32_t start, uint32_t block_size, bool fixed, float threshold) {
+	if (threshold < 0) {
+		return 0;
+	}
+	int32_t quiet_level = (int32_t) (threshold * INT16_MAX);
+	uint32_t quiet = 0;
+	uint32_t block_end = start;
+	float* buffer = start > 0 ? (float *) malloc(NUM_CHANNELS * block_size * sizeof(float)) : NULL;
+	float* channels[NUM_CHANNELS];
+	int16_t* fixed_channels[NUM_CHANNELS];
+	for (int c = 0; c < NUM_CHANNELS && buffer != NULL; ++c) {
+		channels[c] = buffer + c * block_size;
+		fixed_channels[c] = (int16_t *) channels[c];
+	}
+	while (quiet < FILTER_SIZE - 1) {
+		if (block_end == 0) {
+			quiet = FILTER_SIZE - 1;
+			break;
+		}
+		uint32_t len = block_end < block_size ? block_end : block_size;
+		bool silent = buffer != NULL && tinywav_seek(tw, block_end - len) == 0;
+		if (fixed) {
+			silent = silent && tinywav_read_i16(tw, fixed_channels, len) == (int) len
+			    && block_peak_i16(fixed_channels, len) <= quiet_level;
+		} else {
+			silent = silent && tinywav_read_f(tw, channels, len) == (int) len && block_peak(channels, len) <= threshold;
+		}
+		if (!silent) {
+			break;
+		}
+		quiet += len;
+		block_end -= len;
+	}
+	free(buffer);
+	return quiet;
+}
 
-	// load audio file
-	int f_res = tinywav_open_read(&tw, audio_file, TW_SPLIT);
+int binaural_render(TinyWav *tw, TinyWav *tw_out, BinauralFilter* filter, const BinauralOptions* options, FftConv* plan) {
+
+	// pick block size and kernel, from the autotune wisdom if it covers this filter
+	BinauralOptions tuned;
+	binaural_options_resolve(options, filter, &tuned);
+	uint32_t block_size = tuned.blockSize;
+
+	FftConv own_plan;
+	FftConv* fc = NULL;
+	BinauralKernel kernel = tuned.kernel == BINAURAL_KERNEL_Q15 ? BINAURAL_KERNEL_DIRECT : tuned.kernel;
+	if (kernel == BINAURAL_KERNEL_FFT) {
+		if (plan != NULL && plan->n >= fft_conv_min_size(block_size)) {
+			fc = plan; // prepared by the caller for this filter
+		} else if (fft_conv_init(&own_plan, tuned.fftSize, filter) == 0) {
+			fc = &own_plan;
+		} else {
+			kernel = BINAURAL_KERNEL_DIRECT;
+		}
+	}
+	if (options->progress) {
+		printf("kernel: %s, block size: %u, fft size: %u\r\n",
+		    kernel == BINAURAL_KERNEL_FFT ? "fft" : "direct", block_size, kernel == BINAURAL_KERNEL_FFT ? fc->n : 0);
+	}
 
-	// get # of elements of data block per channel
-	uint32_t data_size = tw.h.Subchunk2Size / (sizeof(float));
-																				  // 8 = 4 * 2 (4 bytes/float * 2 channels
-	sample_rate = (uint32_t) tw.h.SampleRate;          // get audio's sample rate
-	uint32_t data_left = data_size;
-	uint32_t iteration = (uint32_t)ceil((float)data_size/CONVOLVE_BLOCK_SIZE);
+	// per call buffers so that renders may run concurrently: a history ring per input channel
+	// and an output block of FILTER_SIZE - 1 + block_size per channel
+	uint32_t stride = (FILTER_SIZE - 1) + block_size;
+	RingBuffer rings[NUM_CHANNELS] = {{0}};
+	float* sample_out = (float *) calloc(NUM_CHANNELS * stride, sizeof(float));
+	bool ready = sample_out != NULL;
+	for (int j = 0; j < NUM_CHANNELS; ++j) {
+		ready = ready && ring_buffer_init(&rings[j], FILTER_SIZE - 1, block_size) == 0;
+	}
 
-	// prepare output file
-	static TinyWav tw_out;
-	tinywav_open_write(&tw_out,
-	    2,
-	    sample_rate,
-	    TW_FLOAT32, // the output samples will be 32-bit floats. TW_INT16 is also supported
-	    TW_SPLIT,   // the samples to be written will be provided by an array of pointer
-								  // that points to different sub-arrays: [[L,L,L,L], [R,R,R,R]]
-	    output_path // the output path
-	);
+	// get # of frames (samples per channel) to convolve: the requested range of the input
+	uint32_t end = options->endFrame < (uint32_t) tw->numFramesInHeader ? options->endFrame : (uint32_t) tw->numFramesInHeader;
+	uint32_t start = options->startFrame < end ? options->startFrame : end;
+	uint32_t data_left = end - start;
+	uint32_t iteration = (data_left + block_size - 1) / block_size;
 
-	// Prepare array to cache the tail of current samples to prepend to next convolving block
-	static float cache_last_samples[(NUM_CHANNELS * (FILTER_SIZE - 1))] = {0};
-	float* cache_ptrs[NUM_CHANNELS];
-  
 	// For audio read
-	// samples are cached in TW_SPLIT format: [[L,L,L,L], [R,R,R,R]]
-	static float samples[(NUM_CHANNELS * CONVOLVE_BLOCK_SIZE) + ((FILTER_SIZE - 1) * NUM_CHANNELS)] = {0};
-	// create pointers for left and right channel in samples array
+	// samples are read in TW_SPLIT format: [[L,L,L,L], [R,R,R,R]], each channel straight into
+	// its ring, behind the FILTER_SIZE - 1 samples of history the convolution needs
 	float* sample_ptrs[NUM_CHANNELS];
-  
+	float* sample_ptrs_offset[NUM_CHANNELS];
+
 	// For audio write
 	// array to store converted binaural sample
-	static float sample_out[(NUM_CHANNELS * CONVOLVE_BLOCK_SIZE) + ((FILTER_SIZE - 1) * NUM_CHANNELS)] = {0};
 	float* sample_out_ptrs[NUM_CHANNELS];
-  
-	// sample pointers to offset for prepended cache when i > 0
-	static float* sample_ptrs_offset[NUM_CHANNELS];
 	float* sample_out_ptrs_offset[NUM_CHANNELS];
-  
-	// generate pointers to different channel section for both read and write
-	for (int j = 0; j < NUM_CHANNELS; ++j) {
-		cache_ptrs[j] = cache_last_samples + j * (FILTER_SIZE - 1);
-		sample_ptrs[j] = samples + j * (CONVOLVE_BLOCK_SIZE + (FILTER_SIZE - 1));
-		sample_out_ptrs[j] = sample_out + j * (CONVOLVE_BLOCK_SIZE + (FILTER_SIZE - 1));
-		sample_ptrs_offset[j] = sample_ptrs[j] + (FILTER_SIZE - 1);
+	for (int j = 0; j < NUM_CHANNELS && ready; ++j) {
+		sample_out_ptrs[j] = sample_out + j * stride;
 		sample_out_ptrs_offset[j] = sample_out_ptrs[j] + (FILTER_SIZE - 1);
 	}
-  
-	for (int i = 0; i < iteration; ++i) {
-		uint32_t input_seq_length = data_left < CONVOLVE_BLOCK_SIZE ? data_left : CONVOLVE_BLOCK_SIZE;
-    uint32_t sample_length;
-		if(i == 0) {
-			sample_length = input_seq_length;
-		} else {
-			sample_length = input_seq_length + FILTER_SIZE - 1;
+
+	// number of silent frames leading up to the current block; the output of a silent block
+	// is only silent too once the whole filter history (FILTER_SIZE - 1 frames) is silent
+	uint32_t quiet_frames = ready ? quiet_history(tw, start, block_size, false, options->silenceThreshold) : 0;
+	uint32_t skipped = 0;
+
+	// starting mid-file: the FILTER_SIZE - 1 frames before the range become the filter history
+	// (frames before the start of the file stay silent)
+	if (ready && start > 0) {
+		uint32_t preroll = start < FILTER_SIZE - 1 ? start : FILTER_SIZE - 1;
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			sample_ptrs_offset[j] = ring_buffer_window(&rings[j], preroll) + (FILTER_SIZE - 1);
 		}
-  
-	  if(i == 0) {  // 1st iteration (edge case) as there are no data to prepend
-			tinywav_read_f(&tw, sample_ptrs, input_seq_length);
-  
-			// Cache the last n samples of the current block to pad to the next block
-			// so that convolution is continuous (where n = FILTER_SIZE - 1)
-			copy_array_f(cache_ptrs[0], sample_ptrs[0], 0, input_seq_length - FILTER_SIZE + 1, FILTER_SIZE - 1);
-			copy_array_f(cache_ptrs[1], sample_ptrs[1], 0, input_seq_length - FILTER_SIZE + 1, FILTER_SIZE - 1);
-			// Convolution: A:= filter, B:= input seq
-			// Convolution for Left channel
-      conv_32(filter_l, sample_ptrs[0], sample_out_ptrs[0], 0, input_seq_length);
-			// Convolution for Right channel
-			conv_32(filter_r, sample_ptrs[1], sample_out_ptrs[1], 0, input_seq_length);
-  
-			//copy_array_f(sample_out_ptrs[1], sample_ptrs[1], 0, 0, input_seq_length);  // TEST
-			tinywav_write_f(&tw_out, sample_out_ptrs, input_seq_length);
-  
-		} else {  // i > 0 => prepend data first and then convolve so convolution is continuous
-			//sample_length = input_seq_length + FILTER_SIZE - 1;
-			// load cache, prepend tail of last block into current block
-			copy_array_f(sample_ptrs[0], cache_ptrs[0], 0, 0, FILTER_SIZE - 1);
-			copy_array_f(sample_ptrs[1], cache_ptrs[1], 0, 0, FILTER_SIZE - 1);
-  
-			tinywav_read_f(&tw, sample_ptrs_offset, input_seq_length);
-  
-			// Cache
-			copy_array_f(cache_ptrs[0], sample_ptrs_offset[0], 0, input_seq_length - FILTER_SIZE + 1, FILTER_SIZE - 1);
-			copy_array_f(cache_ptrs[1], sample_ptrs_offset[1], 0, input_seq_length - FILTER_SIZE + 1, FILTER_SIZE - 1);
-  
+		ready = tinywav_seek(tw, start - preroll) == 0 && tinywav_read_f(tw, sample_ptrs_offset, preroll) == (int) preroll;
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			ring_buffer_advance(&rings[j], preroll);
+		}
+	}
+	if (!ready) {
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			ring_buffer_free(&rings[j]);
+		}
+		free(sample_out);
+		if (fc == &own_plan) {
+			fft_conv_free(&own_plan);
+		}
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < iteration; ++i) {
+		uint32_t input_seq_length = data_left < block_size ? data_left : block_size;
+
+		// window of history followed by room for this block, contiguous in the ring
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			sample_ptrs[j] = ring_buffer_window(&rings[j], input_seq_length);
+			sample_ptrs_offset[j] = sample_ptrs[j] + (FILTER_SIZE - 1);
+		}
+
+		int frames_read = tinywav_read_f(tw, sample_ptrs_offset, input_seq_length);
+		if (frames_read < (int) input_seq_length) { // file shorter than its header claims
+			input_seq_length = frames_read > 0 ? frames_read : 0;
+			data_left = input_seq_length;
+		}
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			ring_buffer_advance(&rings[j], input_seq_length);
+		}
+
+		bool silent = block_peak(sample_ptrs_offset, input_seq_length) <= options->silenceThreshold;
+		if (silent && quiet_frames >= FILTER_SIZE - 1) {
+			// input and pending filter tail are silent, so is the output
+			for (int c = 0; c < NUM_CHANNELS; ++c) {
+				memset(sample_out_ptrs_offset[c], 0, input_seq_length * sizeof(float));
+			}
+			skipped++;
+		} else if (kernel == BINAURAL_KERNEL_FFT) {
+			fft_conv_process(fc, sample_ptrs, sample_out_ptrs, input_seq_length);
+		} else {
 			// Convolution: A:= filter, B:= input seq
-			// Convolution for Left channel
-      conv_32(filter_l, sample_ptrs[0], sample_out_ptrs[0], FILTER_SIZE - 1, input_seq_length);
-			// Convolution for Right channel
-			conv_32(filter_r, sample_ptrs[1], sample_out_ptrs[1], FILTER_SIZE - 1, input_seq_length);
-      
-			//copy_array_f(sample_out_ptrs[1], sample_ptrs_offset[1], 256, 0, input_seq_length);  // TEST
-			tinywav_write_f(&tw_out, sample_out_ptrs_offset, input_seq_length);
+			for (int c = 0; c < NUM_CHANNELS; ++c) {
+				conv_dispatch(filter->taps[c], filter->len[c], filter->delay[c],
+				    sample_ptrs[c], sample_out_ptrs[c], FILTER_SIZE - 1, input_seq_length);
 			}
-  
+		}
+		quiet_frames = silent ? quiet_frames + input_seq_length : 0;
+
+		tinywav_write_f(tw_out, sample_out_ptrs_offset, input_seq_length);
+
 		data_left -= input_seq_length;
 		// print to console every 10 rounds or end of loop
-		if(i % 10 == 0 || i == iteration - 1) {
-			printf("done convolution block: %d / %d (%i)\r\n", i, iteration - 1);
+		if(options->progress && (i % 10 == 0 || i == iteration - 1)) {
+			printf("done convolution block: %u / %u\r\n", i, iteration - 1);
+		}
+	}
+	if (options->progress && skipped > 0) {
+		printf("skipped %u silent blocks\r\n", skipped);
+	}
+	for (int j = 0; j < NUM_CHANNELS; ++j) {
+		ring_buffer_free(&rings[j]);
+	}
+	free(sample_out);
+	if (fc == &own_plan) {
+		fft_conv_free(&own_plan);
+	}
+	return 0;
+}
+
+int binaural_render_q15(TinyWav *tw, TinyWav *tw_out, const BinauralFilterQ15* filter, const BinauralOptions* options) {
+
+	if (tw->sampFmt != TW_INT16 || tw_out->sampFmt != TW_INT16) {
+		return -1;
+	}
+	uint32_t block_size = options->blockSize >= 1 && options->blockSize <= MAX_CONVOLVE_BLOCK_SIZE ? options->blockSize : CONVOLVE_BLOCK_SIZE;
+	if (options->progress) {
+		printf("kernel: q15, block size: %u\r\n", block_size);
+	}
+
+	// per call buffers: an int16 history ring per input channel, with room behind each block
+	// for the few frames past it that conv_q15() reads, and an output block per channel
+	uint32_t out_stride = (FILTER_SIZE - 1) + block_size;
+	RingBuffer rings[NUM_CHANNELS] = {{0}};
+	int16_t* sample_out = (int16_t *) calloc(NUM_CHANNELS * out_stride, sizeof(int16_t));
+	bool ready = sample_out != NULL;
+	for (int j = 0; j < NUM_CHANNELS; ++j) {
+		ready = ready && ring_buffer_init_i16(&rings[j], FILTER_SIZE - 1, block_size + Q15_GROUP) == 0;
+	}
+
+	uint32_t end = options->endFrame < (uint32_t) tw->numFramesInHeader ? options->endFrame : (uint32_t) tw->numFramesInHeader;
+	uint32_t start = options->startFrame < end ? options->startFrame : end;
+	uint32_t data_left = end - start;
+	uint32_t iteration = (data_left + block_size - 1) / block_size;
+
+	int16_t* sample_ptrs[NUM_CHANNELS];
+	int16_t* sample_ptrs_offset[NUM_CHANNELS];
+	int16_t* sample_out_ptrs[NUM_CHANNELS];
+	int16_t* sample_out_ptrs_offset[NUM_CHANNELS];
+	for (int j = 0; j < NUM_CHANNELS && ready; ++j) {
+		sample_out_ptrs[j] = sample_out + j * out_stride;
+		sample_out_ptrs_offset[j] = sample_out_ptrs[j] + (FILTER_SIZE - 1);
+	}
+
+	// silence is compared in int16 units; the one float operation of the render
+	int32_t quiet_level = options->silenceThreshold < 0 ? -1 : (int32_t) (options->silenceThreshold * INT16_MAX);
+	uint32_t quiet_frames = ready ? quiet_history(tw, start, block_size, true, options->silenceThreshold) : 0;
+	uint32_t skipped = 0;
+
+	// starting mid-file: the frames before the range become the end of the history
+	if (ready && start > 0) {
+		uint32_t preroll = start < FILTER_SIZE - 1 ? start : FILTER_SIZE - 1;
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			sample_ptrs_offset[j] = ring_buffer_window_i16(&rings[j], preroll) + (FILTER_SIZE - 1);
+		}
+		ready = tinywav_seek(tw, start - preroll) == 0 && tinywav_read_i16(tw, sample_ptrs_offset, preroll) == (int) preroll;
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			ring_buffer_advance(&rings[j], preroll);
+		}
+	}
+	if (!ready) {
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			ring_buffer_free(&rings[j]);
+		}
+		free(sample_out);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < iteration; ++i) {
+		uint32_t input_seq_length = data_left < block_size ? data_left : block_size;
+
+		// the window covers the Q15_GROUP frames conv_q15() reads past the block
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			sample_ptrs[j] = ring_buffer_window_i16(&rings[j], input_seq_length + Q15_GROUP);
+			sample_ptrs_offset[j] = sample_ptrs[j] + (FILTER_SIZE - 1);
+		}
+
+		int frames_read = tinywav_read_i16(tw, sample_ptrs_offset, input_seq_length);
+		if (frames_read < (int) input_seq_length) { // file shorter than its header claims
+			input_seq_length = frames_read > 0 ? frames_read : 0;
+			data_left = input_seq_length;
+		}
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			ring_buffer_advance(&rings[j], input_seq_length);
+		}
+
+		bool silent = block_peak_i16(sample_ptrs_offset, input_seq_length) <= quiet_level;
+		if (silent && quiet_frames >= FILTER_SIZE - 1) {
+			for (int c = 0; c < NUM_CHANNELS; ++c) {
+				memset(sample_out_ptrs_offset[c], 0, input_seq_length * sizeof(int16_t));
+			}
+			skipped++;
+		} else {
+			for (int c = 0; c < NUM_CHANNELS; ++c) {
+				conv_q15(filter, c, sample_ptrs[c], sample_out_ptrs[c], FILTER_SIZE - 1, input_seq_length);
+			}
 		}
+		quiet_frames = silent ? quiet_frames + input_seq_length : 0;
+
+		tinywav_write_i16(tw_out, sample_out_ptrs_offset, input_seq_length);
+
+		data_left -= input_seq_length;
+		if(options->progress && (i % 10 == 0 || i == iteration - 1)) {
+			printf("done convolution block: %u / %u\r\n", i, iteration - 1);
+		}
+	}
+	if (options->progress && skipped > 0) {
+		printf("skipped %u silent blocks\r\n", skipped);
+	}
+	for (int j = 0; j < NUM_CHANNELS; ++j) {
+		ring_buffer_free(&rings[j]);
 	}
+	free(sample_out);
+	return 0;
+}
+
+/** @returns true if binaural_render_to() renders tw through binaural_render_q15() */
+static bool binaural_uses_q15(const TinyWav *tw, const BinauralOptions* options) {
+	// int16 input with the fixed-point kernel: int16 output, no float conversion on the way
+	return options->kernel == BINAURAL_KERNEL_Q15 && tw->sampFmt == TW_INT16 && options->outputFormat != TW_FLAC24;
+}
+
+int binaural_render_to(TinyWav *tw, const char* output_path, BinauralFilter* filter, const BinauralOptions* options,
+    FftConv* plan, uint32_t* frames) {
 
+	bool q15 = binaural_uses_q15(tw, options);
+
+	// prepare output file; a render with the cache on, now or earlier, may have left output_path
+	// as a hard link to a cache entry, which must not be written through
+	render_cache_release(output_path);
+	TinyWav tw_out;
+	if (tinywav_open_write(&tw_out,
+	    2,
+	    (int32_t) tw->h.SampleRate, // keep audio's sample rate
+	    q15 ? TW_INT16 : options->outputFormat, // 32-bit floats by default, TW_INT16 and TW_FLAC24 are also supported
+	    TW_SPLIT,   // the samples to be written will be provided by an array of pointer
+								  // that points to different sub-arrays: [[L,L,L,L], [R,R,R,R]]
+	    output_path // the output path
+	) != 0) {
+		return -1;
+	}
+	tinywav_set_encoder_threads(&tw_out, options->encoderThreads);
+
+	int res = -1;
+	if (q15) {
+		BinauralFilterQ15 fixed;
+		res = binaural_filter_to_q15(filter, &fixed) == 0 ? binaural_render_q15(tw, &tw_out, &fixed, options) : -1;
+	} else {
+		res = binaural_render(tw, &tw_out, filter, options, plan);
+	}
+	if (frames != NULL) {
+		*frames = tw_out.totalFramesReadWritten;
+	}
 	tinywav_close_write(&tw_out);
+	return res;
+}
+
+/**
+ * Render audio_file through the filter into output_path, or place the earlier result there
+ * when the output cache holds one for the same input data, filter and settings.
+ */
+static int binaural_render_file(const char* audio_file, const char* output_path, BinauralFilter* filter,
+    const BinauralOptions* options) {
+
+	uint64_t key = 0;
+	bool cached = false;
+	if (options->cacheDir != NULL) {
+		BinauralOptions resolved;
+		binaural_options_resolve(options, filter, &resolved);
+		cached = render_cache_key(audio_file, filter, &resolved, &key) == 0;
+		if (cached && render_cache_fetch(options->cacheDir, key, output_path) == 0) {
+			printf("cache hit: %016llx\r\n", (unsigned long long) key);
+			return 0;
+		}
+	}
+
+	// setup for audio file comprehension and format
+	TinyWav tw; // address to store read audio file
+
+	// load audio file
+	if (tinywav_open_read(&tw, audio_file, TW_SPLIT) != 0) {
+		return -1;
+	}
+	int res = binaural_render_to(&tw, output_path, filter, options, NULL, NULL);
+	tinywav_close_read(&tw);
+
+	if (res == 0 && cached) {
+		render_cache_store(options->cacheDir, options->cacheMaxBytes, key, output_path);
+	}
+	return res;
+}
+
+void binaural_compute(int degrees, char* audio_file) {
+	binaural_compute_ex(degrees, audio_file, NULL);
+}
+
+/** outputs/<degrees>_degrees_[<start>-<end>_]<file>, with the extension .flac for TW_FLAC24 */
+static void binaural_output_path(char* output_path, size_t size, int degrees, const char* audio_file,
+    const BinauralOptions* options) {
+	int len = snprintf(output_path, size, "outputs/%d_degrees_", degrees);
+	if (options->startFrame > 0 || options->endFrame != UINT32_MAX) {
+		// a time range: outputs/<degrees>_degrees_<start>-<end>_<file>
+		len += snprintf(output_path + len, size - len, "%u-%u_", options->startFrame, options->endFrame);
+	}
+	snprintf(output_path + len, size - len, "%s", audio_file);
+	if (options->outputFormat == TW_FLAC24) {
+		// outputs/<degrees>_degrees_<file>.flac, replacing the input's extension
+		char* ext = strrchr(output_path, '.');
+		if (ext != NULL && strchr(ext, '/') == NULL) {
+			*ext = '\0';
+		}
+		strncat(output_path, ".flac", size - strlen(output_path) - 1);
+	}
+}
+
+static int binaural_snap_degrees(int degrees) {
+	// get snapped angle that is multiple of 30 degrees
+	int snap_seg = (int) round(((float) degrees) / 30);
+	int snap_deg = snap_seg * 30;
+	return snap_deg % 360;
+}
+
+static int binaural_compute_file(int degrees, char* audio_file, const BinauralOptions* options) {
+
+	int snap_deg = binaural_snap_degrees(degrees);
+	printf("snap_deg: %d, degrees: %d\r\n", snap_deg, degrees);
+
+	// build output file path
+	char output_path[128] = "";
+	binaural_output_path(output_path, sizeof(output_path), degrees, audio_file, options);
+
+	printf("output path: %s \r\n", output_path);
+	// load filter's LR channels
+	static BinauralFilter filter;
+	if (binaural_load_filter(snap_deg, &filter) != 0) {
+		return -1;
+	}
+
+	return binaural_render_file(audio_file, output_path, &filter, options);
+}
+
+void binaural_compute_ex(int degrees, char* audio_file, const BinauralOptions* options) {
+
+	BinauralOptions defaults;
+	if (options == NULL) {
+		binaural_options_default(&defaults);
+		options = &defaults;
+	}
+	binaural_compute_file(degrees, audio_file, options);
+}
+
+/**
+ * The options of shard `shard` of `shards`: the range of options split on whole blocks of the
+ * block size the render resolves to, so each shard convolves the very blocks a single render does.
+ */
+static int binaural_shard_options(int degrees, const char* audio_file, uint32_t shard, uint32_t shards,
+    const BinauralOptions* options, BinauralOptions* shard_options) {
+
+	if (shards < 1 || shard >= shards) {
+		return -1;
+	}
+	BinauralFilter filter;
+	if (binaural_load_filter(binaural_snap_degrees(degrees), &filter) != 0) {
+		return -1;
+	}
+	BinauralOptions resolved;
+	binaural_options_resolve(options, &filter, &resolved);
+
+	TinyWav tw;
+	if (tinywav_open_read(&tw, audio_file, TW_SPLIT) != 0) {
+		return -1;
+	}
+	uint32_t frames = (uint32_t) tw.numFramesInHeader;
 	tinywav_close_read(&tw);
+
+	uint32_t end = options->endFrame < frames ? options->endFrame : frames;
+	uint32_t start = options->startFrame < end ? options->startFrame : end;
+	uint64_t block = resolved.blockSize;
+	uint64_t blocks = (end - start + block - 1) / block;
+	uint64_t first = start + blocks * shard / shards * block;
+	uint64_t last = start + blocks * (shard + 1) / shards * block;
+
+	*shard_options = *options;
+	shard_options->startFrame = (uint32_t) (first < end ? first : end);
+	shard_options->endFrame = (uint32_t) (last < end ? last : end);
+	return 0;
+}
+
+int binaural_compute_shard(int degrees, char* audio_file, uint32_t shard, uint32_t shards, const BinauralOptions* options) {
+
+	BinauralOptions defaults;
+	if (options == NULL) {
+		binaural_options_default(&defaults);
+		options = &defaults;
+	}
+	BinauralOptions shard_options;
+	if (binaural_shard_options(degrees, audio_file, shard, shards, options, &shard_options) != 0) {
+		return -1;
+	}
+	printf("shard %u / %u: frames %u - %u\r\n", shard, shards, shard_options.startFrame, shard_options.endFrame);
+	return binaural_compute_file(degrees, audio_file, &shard_options);
+}
+
+int binaural_stitch_shards(int degrees, char* audio_file, uint32_t shards, const BinauralOptions* options) {
+
+	BinauralOptions defaults;
+	if (options == NULL) {
+		binaural_options_default(&defaults);
+		options = &defaults;
+	}
+	if (options->outputFormat == TW_FLAC24) {
+		printf("[stitch] FLAC shards cannot be stitched, render them as wav\r\n");
+		return -1;
+	}
+
+	char output_path[128] = "";
+	binaural_output_path(output_path, sizeof(output_path), degrees, audio_file, options);
+	// never write through a hard link into the render cache
+	render_cache_release(output_path);
+
+	TinyWav tw_out;
+	bool opened = false;
+	int res = 0;
+	for (uint32_t k = 0; k < shards && res == 0; k++) {
+		BinauralOptions shard_options;
+		char shard_path[128] = "";
+		TinyWav tw;
+		if (binaural_shard_options(degrees, audio_file, k, shards, options, &shard_options) != 0) {
+			res = -1;
+			break;
+		}
+		binaural_output_path(shard_path, sizeof(shard_path), degrees, audio_file, &shard_options);
+		if (tinywav_open_read(&tw, shard_path, TW_SPLIT) != 0) {
+			printf("[stitch] Missing shard %u: %s\r\n", k, shard_path);
+			res = -1;
+			break;
+		}
+
+		// the first shard sets the format, the rest must match it and be complete
+		uint32_t frames = shard_options.endFrame - shard_options.startFrame;
+		if (!opened) {
+			opened = tinywav_open_write(&tw_out, tw.numChannels, (int32_t) tw.h.SampleRate, tw.sampFmt, TW_SPLIT, output_path) == 0;
+			res = opened ? 0 : -1;
+		} else if (tw.numChannels != tw_out.numChannels || tw.h.SampleRate != tw_out.h.SampleRate || tw.sampFmt != tw_out.sampFmt) {
+			printf("[stitch] Shard %u has a different format\r\n", k);
+			res = -1;
+		}
+		if (res == 0 && (uint32_t) tw.numFramesInHeader != frames) {
+			printf("[stitch] Shard %u has %d frames, expected %u\r\n", k, tw.numFramesInHeader, frames);
+			res = -1;
+		}
+
+		// the data chunk is copied as is, the samples are never decoded
+		char buffer[65536];
+		size_t left = (size_t) frames * tw.h.BlockAlign;
+		while (res == 0 && left > 0) {
+			size_t n = left < sizeof(buffer) ? left : sizeof(buffer);
+			if (fread(buffer, 1, n, tw.f) != n || fwrite(buffer, 1, n, tw_out.f) != n) {
+				res = -1;
+			}
+			left -= n;
+		}
+		if (res == 0) {
+			tw_out.totalFramesReadWritten += frames;
+		}
+		tinywav_close_read(&tw);
+	}
+
+	if (opened) {
+		tinywav_close_write(&tw_out); // patches the header sizes
+	}
+	if (res != 0) {
+		remove(output_path);
+		return -1;
+	}
+	printf("stitched %u shards: %s\r\n", shards, output_path);
+	return 0;
+}
+
+/** Ask the kernel to start reading a file in the background, so it is cached when opened */
+static void binaural_readahead(const char* path) {
+#if defined(__linux__)
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+#else
+	(void) path;
+#endif
+}
+
+typedef struct BatchClip {
+	uint32_t file;       ///< index into the file list
+	uint32_t offset;     ///< first frame in the packed buffer
+	uint32_t frames;
+	uint32_t sampleRate;
+} BatchClip;
+
+/** Write frames [offset, offset + frames) of the packed output as clip's own file */
+static int binaural_batch_scatter(float** out, const BatchClip* clip, const char* output_path, const BinauralOptions* options) {
+	render_cache_release(output_path); // never write through a hard link into the render cache
+	TinyWav tw_out;
+	if (tinywav_open_write(&tw_out, 2, (int32_t) clip->sampleRate, options->outputFormat, TW_SPLIT, output_path) != 0) {
+		return -1;
+	}
+	tinywav_set_encoder_threads(&tw_out, options->encoderThreads);
+	for (uint32_t done = 0; done < clip->frames; ) {
+		uint32_t n = clip->frames - done < MAX_CONVOLVE_BLOCK_SIZE ? clip->frames - done : MAX_CONVOLVE_BLOCK_SIZE;
+		float* ptrs[NUM_CHANNELS];
+		for (int c = 0; c < NUM_CHANNELS; ++c) {
+			ptrs[c] = out[c] + clip->offset + done;
+		}
+		tinywav_write_f(&tw_out, ptrs, n);
+		done += n;
+	}
+	tinywav_close_write(&tw_out);
+	return 0;
+}
+
+int binaural_compute_batch(int degrees, char** audio_files, uint32_t count, const BinauralOptions* options) {
+
+	BinauralOptions defaults;
+	if (options == NULL) {
+		binaural_options_default(&defaults);
+		options = &defaults;
+	}
+	// whole clips only; the cache is keyed per render and only consulted for clips rendered alone
+	BinauralOptions clip_options = *options;
+	clip_options.startFrame = 0;
+	clip_options.endFrame = UINT32_MAX;
+	clip_options.progress = false;
+	BinauralOptions alone_options = clip_options;
+	clip_options.cacheDir = NULL;
+
+	BinauralFilter filter;
+	if (binaural_load_filter(binaural_snap_degrees(degrees), &filter) != 0) {
+		return -1;
+	}
+	BinauralOptions tuned;
+	binaural_options_resolve(&clip_options, &filter, &tuned);
+	uint32_t block_size = tuned.blockSize;
+	FftConv fc;
+	bool fft = tuned.kernel == BINAURAL_KERNEL_FFT && fft_conv_init(&fc, tuned.fftSize, &filter) == 0;
+
+	// one packed buffer per channel: FILTER_SIZE - 1 frames of silence, then every clip followed
+	// by FILTER_SIZE - 1 frames of silence, so each clip starts on the silent history a render
+	// of it alone would see; room for one more block rounds the last one up
+	uint32_t history = FILTER_SIZE - 1;
+	uint32_t stride = history + BINAURAL_BATCH_FRAMES + block_size;
+	float* in = (float *) calloc(NUM_CHANNELS * stride, sizeof(float));
+	float* out = (float *) calloc(NUM_CHANNELS * stride, sizeof(float));
+	BatchClip* clips = (BatchClip *) malloc((count > 0 ? count : 1) * sizeof(BatchClip));
+	if (in == NULL || out == NULL || clips == NULL) {
+		free(in);
+		free(out);
+		free(clips);
+		if (fft) {
+			fft_conv_free(&fc);
+		}
+		return -1;
+	}
+	float* in_ptrs[NUM_CHANNELS];
+	float* out_ptrs[NUM_CHANNELS];
+	for (int c = 0; c < NUM_CHANNELS; ++c) {
+		in_ptrs[c] = in + c * stride;
+		out_ptrs[c] = out + c * stride;
+	}
+
+	for (uint32_t k = 0; k < count && k < BINAURAL_BATCH_READAHEAD; k++) {
+		binaural_readahead(audio_files[k]);
+	}
+
+	int failures = 0;
+	uint32_t next = 0;
+	while (next < count) {
+		// pack as many clips as fit
+		uint32_t clip_count = 0;
+		uint32_t packed = history;
+		while (next < count) {
+			TinyWav tw;
+			if (tinywav_open_read(&tw, audio_files[next], TW_SPLIT) != 0) {
+				failures++;
+				next++;
+				continue;
+			}
+			uint32_t frames = (uint32_t) tw.numFramesInHeader;
+			// above digital silence a render skips blocks on the grid of the clip's own blocks,
+			// which the packed blocks do not follow
+			bool alone = frames > BINAURAL_BATCH_FRAMES || binaural_uses_q15(&tw, &clip_options)
+			    || clip_options.silenceThreshold > 0;
+			if (alone) {
+				// too long to pack, int16 for the fixed-point kernel, which the float buffers
+				// cannot render, or skipping above silence: rendered on its own, as
+				// binaural_compute_ex() would
+				tinywav_close_read(&tw);
+				char output_path[128] = "";
+				binaural_output_path(output_path, sizeof(output_path), degrees, audio_files[next], &clip_options);
+				failures += binaural_render_file(audio_files[next], output_path, &filter, &alone_options) != 0;
+				next++;
+				continue;
+			}
+			if (packed + frames > history + BINAURAL_BATCH_FRAMES) {
+				tinywav_close_read(&tw); // batch full, this clip starts the next one
+				break;
+			}
+
+			uint32_t got = 0;
+			while (got < frames) {
+				uint32_t n = frames - got < MAX_CONVOLVE_BLOCK_SIZE ? frames - got : MAX_CONVOLVE_BLOCK_SIZE;
+				float* ptrs[NUM_CHANNELS];
+				for (int c = 0; c < NUM_CHANNELS; ++c) {
+					ptrs[c] = in_ptrs[c] + packed + got;
+				}
+				int r = tinywav_read_f(&tw, ptrs, n);
+				if (r <= 0) {
+					break; // file shorter than its header claims
+				}
+				got += r;
+			}
+			clips[clip_count].file = next;
+			clips[clip_count].offset = packed;
+			clips[clip_count].frames = got;
+			clips[clip_count].sampleRate = tw.h.SampleRate;
+			clip_count++;
+			packed += got + history;
+			tinywav_close_read(&tw);
+
+			next++;
+			if (next + BINAURAL_BATCH_READAHEAD - 1 < count) {
+				binaural_readahead(audio_files[next + BINAURAL_BATCH_READAHEAD - 1]);
+			}
+		}
+		if (clip_count == 0) {
+			continue;
+		}
+
+		// convolve the packed clips in whole blocks; blocks of digital silence (separators,
+		// padding or silent clips) with a silent history are left as zeros, which is what the
+		// convolution would give, so the skipping matches the clip rendered alone
+		uint32_t end = clips[clip_count - 1].offset + clips[clip_count - 1].frames;
+		uint32_t skipped = 0;
+		for (uint32_t p = history; p < end; p += block_size) {
+			float* windows[NUM_CHANNELS];
+			float* outputs[NUM_CHANNELS];
+			for (int c = 0; c < NUM_CHANNELS; ++c) {
+				windows[c] = in_ptrs[c] + p - history;
+				outputs[c] = out_ptrs[c] + p - history;
+			}
+			if (block_peak(windows, history + block_size) <= clip_options.silenceThreshold) {
+				for (int c = 0; c < NUM_CHANNELS; ++c) {
+					memset(out_ptrs[c] + p, 0, block_size * sizeof(float));
+				}
+				skipped++;
+			} else if (fft) {
+				fft_conv_process(&fc, windows, outputs, block_size);
+			} else {
+				for (int c = 0; c < NUM_CHANNELS; ++c) {
+					conv_dispatch(filter.taps[c], filter.len[c], filter.delay[c], in_ptrs[c], out_ptrs[c], p, block_size);
+				}
+			}
+		}
+		if (options->progress) {
+			printf("batch: %u clips, %u frames, %u silent blocks skipped\r\n", clip_count, end - history, skipped);
+		}
+
+		for (uint32_t k = 0; k < clip_count; k++) {
+			char output_path[128] = "";
+			binaural_output_path(output_path, sizeof(output_path), degrees, audio_files[clips[k].file], &clip_options);
+			failures += binaural_batch_scatter(out_ptrs, &clips[k], output_path, &clip_options) != 0;
+		}
+
+		// back to silence for the next batch
+		for (int c = 0; c < NUM_CHANNELS; ++c) {
+			uint32_t used = ((end - history + block_size - 1) / block_size) * block_size + history;
+			memset(in_ptrs[c], 0, used * sizeof(float));
+		}
+	}
+
+	free(in);
+	free(out);
+	free(clips);
+	if (fft) {
+		fft_conv_free(&fc);
+	}
+	return failures == 0 ? 0 : -1;
 }
 
+void binaural_compute_db(const char* db_path, float azimuth, float elevation, char* audio_file) {
+
+	// build output file path
+	char output_path[128] = "";
+	snprintf(output_path, sizeof(output_path), "outputs/%g_%g_degrees_%s", azimuth, elevation, audio_file);
+
+	HrirDb db;
+	if (hrir_db_open(&db, db_path) != 0) {
+		return;
+	}
+	if (db.h.NumChannels != NUM_CHANNELS) {
+		printf("[binaural] %s has %u channels, expected %d\r\n", db_path, db.h.NumChannels, NUM_CHANNELS);
+		hrir_db_close(&db);
+		return;
+	}
+
+	// interpolate the filter for this direction; only the (up to) 3 surrounding
+	// measurements are ever paged in from the database; FilterSize comes from the file, so the
+	// buffers are on the heap, not the stack
+	float* interpolated[NUM_CHANNELS];
+	bool ready = true;
+	for (int j = 0; j < NUM_CHANNELS; ++j) {
+		interpolated[j] = (float *) malloc((size_t) db.h.FilterSize * sizeof(float));
+		ready = ready && interpolated[j] != NULL;
+	}
+	if (!ready || hrir_db_interpolate(&db, azimuth, elevation, interpolated) != 0) {
+		printf("[binaural] Cannot interpolate %g, %g from %s\r\n", azimuth, elevation, db_path);
+		for (int j = 0; j < NUM_CHANNELS; ++j) {
+			free(interpolated[j]);
+		}
+		hrir_db_close(&db);
+		return;
+	}
 
-int main() {
+	// the render path convolves at most FILTER_SIZE taps, longer sets are truncated
+	static BinauralFilter filter;
+	memset(&filter, 0, sizeof(filter));
+	uint32_t taps = db.h.FilterSize < FILTER_SIZE ? db.h.FilterSize : FILTER_SIZE;
+	for (int c = 0; c < NUM_CHANNELS; ++c) {
+		copy_array_f(filter.taps[c], interpolated[c], 0, 0, taps);
+		filter.len[c] = taps;
+		filter.delay[c] = 0;
+		free(interpolated[c]);
+	}
+	hrir_db_close(&db);
+
+	printf("database: %s, azimuth: %g, elevation: %g\r\n", db_path, azimuth, elevation);
+	printf("output path: %s \r\n", output_path);
+
+	BinauralOptions options;
+	binaural_options_default(&options);
+	binaural_render_file(audio_file, output_path, &filter, &options);
+}
+
+
+#ifndef TINYWAV_NO_MAIN
+int main(int argc, char** argv) {
+  // tune the render backends for this machine: autotune [taps] [max latency in frames]
+  if (argc > 1 && strcmp(argv[1], "autotune") == 0) {
+    uint32_t taps = argc > 2 ? (uint32_t) atoi(argv[2]) : FILTER_SIZE;
+    uint32_t max_latency = argc > 3 ? (uint32_t) atoi(argv[3]) : MAX_CONVOLVE_BLOCK_SIZE;
+    return binaural_autotune(taps, max_latency, BINAURAL_WISDOM_FILE);
+  }
+  // render one shard of a long input, possibly in another process or on another machine:
+  // shard <k> <shards> [degrees] [wav], then stitch <shards> [degrees] [wav] once all are done
+  if (argc > 3 && strcmp(argv[1], "shard") == 0) {
+    return binaural_compute_shard(argc > 4 ? atoi(argv[4]) : 150, argc > 5 ? argv[5] : "music.wav",
+        (uint32_t) atoi(argv[2]), (uint32_t) atoi(argv[3]), NULL) == 0 ? 0 : 1;
+  }
+  if (argc > 2 && strcmp(argv[1], "stitch") == 0) {
+    return binaural_stitch_shards(argc > 3 ? atoi(argv[3]) : 150, argc > 4 ? argv[4] : "music.wav",
+        (uint32_t) atoi(argv[2]), NULL) == 0 ? 0 : 1;
+  }
+  // many short clips in shared buffers: batch <degrees> <wav> [<wav> ...]
+  if (argc > 3 && strcmp(argv[1], "batch") == 0) {
+    return binaural_compute_batch(atoi(argv[2]), argv + 3, (uint32_t) (argc - 3), NULL) == 0 ? 0 : 1;
+  }
+  // many sources through an ambisonic bus: ambisonic <order> <wav> <azimuth> [<wav> <azimuth> ...]
+  if (argc > 4 && strcmp(argv[1], "ambisonic") == 0) {
+    int num_sources = (argc - 3) / 2;
+    char** files = (char **) malloc(num_sources * sizeof(char*));
+    float* azimuths = (float *) malloc(num_sources * sizeof(float));
+    int res = -1;
+    if (files != NULL && azimuths != NULL) {
+      for (int s = 0; s < num_sources; s++) {
+        files[s] = argv[3 + 2 * s];
+        azimuths[s] = (float) atof(argv[4 + 2 * s]);
+      }
+      res = binaural_compute_ambisonic(num_sources, files, azimuths, atoi(argv[2]), "outputs/ambisonic.wav");
+    }
+    free(files);
+    free(azimuths);
+    return res == 0 ? 0 : 1;
+  }
   binaural_compute(150, "music.wav");
-}
\ No newline at end of file
+}
+#endif
@@ -54,17 +54,22 @@ typedef enum TinyWavChannelFormat {
 
 typedef enum TinyWavSampleFormat {
   TW_INT16 = 2,  // two byte signed integer
+  TW_FLAC24 = 3, // 24-bit FLAC (output only, see flac_writer.h)
   TW_FLOAT32 = 4 // four byte IEEE float
 } TinyWavSampleFormat;
 
+struct FlacWriter;
+
 typedef struct TinyWav {
   FILE *f;
   TinyWavHeader h;
   int16_t numChannels;
   int32_t numFramesInHeader; ///< number of samples per channel declared in wav header (only populated when reading)
   uint32_t totalFramesReadWritten; ///< total numSamples per channel which have been read or written
+  long dataOffset; ///< file position of the first sample frame (only populated when reading)
   TinyWavChannelFormat chanFmt;
   TinyWavSampleFormat sampFmt;
+  struct FlacWriter *flac; ///< encoder of a TW_FLAC24 output, NULL otherwise
 } TinyWav;
 
 /**
@@ -73,6 +78,7 @@ typedef struct TinyWav {
  * @param numChannels  The number of channels to write.
  * @param samplerate   The sample rate of the audio.
  * @param sampFmt      The sample format (e.g. 16-bit integer or 32-bit float) to be used in the file.
+ *                     TW_FLAC24 writes a FLAC stream instead of a wav.
  * @param chanFmt      The channel format (how the channel data is layed out in memory)
  * @param path         The path of the file to write to. The file will be overwritten.
  *
@@ -83,6 +89,14 @@ int tinywav_open_write(TinyWav *tw,
     TinyWavSampleFormat sampFmt, TinyWavChannelFormat chanFmt,
     const char *path);
 
+/**
+ * Encode a TW_FLAC24 output on the given number of threads. Only before the first write;
+ * other formats ignore it.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int tinywav_set_encoder_threads(TinyWav *tw, uint32_t threads);
+
 /**
  * Open a file for reading.
  *
@@ -93,6 +107,26 @@ int tinywav_open_write(TinyWav *tw,
  */
 int tinywav_open_read(TinyWav *tw, const char *path, TinyWavChannelFormat chanFmt);
 
+/**
+ * Read a wav from an already opened stream (e.g. fmemopen() over a memory mapping),
+ * positioned at the start of the RIFF header. The stream is closed by tinywav_close_read().
+ *
+ * @param f        The stream to read.
+ * @param chanFmt  The desired channel format (how the channel data is layed out in memory) when read.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int tinywav_open_read_stream(TinyWav *tw, FILE *f, TinyWavChannelFormat chanFmt);
+
+/**
+ * Move the read position to the given frame, so that the next tinywav_read_f() starts there.
+ *
+ * @param frame  The frame (sample per channel) index, at most numFramesInHeader.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int tinywav_seek(TinyWav *tw, uint32_t frame);
+
 /**
  * Read sample data from the file.
  *
@@ -105,6 +139,14 @@ int tinywav_open_read(TinyWav *tw, const char *path, TinyWavChannelFormat chanFm
  */
 int tinywav_read_f(TinyWav *tw, void *data, int len);
 
+/**
+ * As tinywav_read_f(), but the samples of a TW_INT16 file are returned as they are, in the
+ * same channel layout with int16_t in place of float.
+ *
+ * @return The number of frames (samples per channel) read from file, -1 if the file is not TW_INT16.
+ */
+int tinywav_read_i16(TinyWav *tw, void *data, int len);
+
 /** Stop reading the file. The Tinywav struct is now invalid. */
 void tinywav_close_read(TinyWav *tw);
 
@@ -120,13 +162,220 @@ void tinywav_close_read(TinyWav *tw);
  */
 int tinywav_write_f(TinyWav *tw, void *f, int len);
 
+/**
+ * As tinywav_write_f(), with int16_t samples written as they are to a TW_INT16 file.
+ *
+ * @return The number of frames (samples per channel) written to file, -1 if the file is not TW_INT16.
+ */
+int tinywav_write_i16(TinyWav *tw, void *f, int len);
+
 /** Stop writing to the file. The Tinywav struct is now invalid. */
 void tinywav_close_write(TinyWav *tw);
 
 /** Returns true if the Tinywav struct is available to write or write. False otherwise. */
 bool tinywav_isOpen(TinyWav *tw);
 
+#ifndef FILTER_SIZE
+#define FILTER_SIZE 256          // taps per channel of the filters in dataset_bin
+#endif
+#ifndef CONVOLVE_BLOCK_SIZE
+#define CONVOLVE_BLOCK_SIZE 512  // frames convolved per block
+#endif
+#ifndef MAX_CONVOLVE_BLOCK_SIZE
+#define MAX_CONVOLVE_BLOCK_SIZE 4096  // largest block size selectable at runtime
+#endif
+#ifndef BINAURAL_BATCH_FRAMES
+#define BINAURAL_BATCH_FRAMES 262144  // frames per shared buffer of binaural_compute_batch()
+#endif
+#ifndef BINAURAL_BATCH_READAHEAD
+#define BINAURAL_BATCH_READAHEAD 16   // files binaural_compute_batch() reads ahead
+#endif
+
+void copy_array_f(float* dest, float* src, int dest_offset, int src_offset, int length);
+
+/** output[i] = sum of filter[j] * audio[i - j] over FILTER_SIZE taps, for i in [start, start + len) */
+void conv_32(float* filter, float* audio, float* output, uint32_t start, uint32_t len);
+
+/**
+ * Filter pair as used by the render path. Each channel is a pure delay followed by
+ * taps[c][0 .. len[c]), with delay[c] + len[c] <= FILTER_SIZE. The taps past len[c] are zero.
+ */
+typedef struct BinauralFilter {
+  float taps[2][FILTER_SIZE];
+  uint32_t len[2];    ///< taps used per channel, FILTER_SIZE for untrimmed filters
+  uint32_t delay[2];  ///< onset delay in samples per channel
+} BinauralFilter;
+
+/**
+ * Load the filter for the given direction (a multiple of 30 degrees) from dataset_bin.
+ * If the delay + minimum-phase split produced by utils_python/trim_hrir.py
+ * (<deg>_degrees.min.bin) exists it is preferred over the full <deg>_degrees.bin.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_load_filter(int snap_deg, BinauralFilter* filter);
+
+/** As conv_32(), but over the first taps coefficients of audio delayed by delay samples */
+void conv_32_delay(float* filter, uint32_t taps, uint32_t delay, float* audio, float* output, uint32_t start, uint32_t len);
+
+typedef enum BinauralKernel {
+  BINAURAL_KERNEL_DIRECT, // time domain, conv_32_delay()
+  BINAURAL_KERNEL_FFT,    // frequency domain, see fft_conv.h
+  BINAURAL_KERNEL_Q15,    // fixed point for TW_INT16 inputs, see fixed_conv.h; others render direct
+  BINAURAL_KERNEL_AUTO    // the wisdom's pick for the filter, or BINAURAL_KERNEL_DIRECT without one
+} BinauralKernel;
+
+/** Settings of the render loop, see binaural_options_default() for the defaults */
+typedef struct BinauralOptions {
+  /// A block whose samples all have a magnitude at or below this level counts as silent.
+  /// While both the block and the filter's history are silent the block is written as zeros
+  /// without convolving. 0 (default) only skips digital silence, a negative value never skips.
+  float silenceThreshold;
+  /// Frames per block, 1 to MAX_CONVOLVE_BLOCK_SIZE, or 0 (default) for the wisdom's pick,
+  /// CONVOLVE_BLOCK_SIZE without one.
+  uint32_t blockSize;
+  BinauralKernel kernel;  ///< convolution backend (default BINAURAL_KERNEL_AUTO)
+  uint32_t fftSize;       ///< FFT size of BINAURAL_KERNEL_FFT, 0 (default) for the wisdom's or the smallest that fits
+  /// Wisdom file written by binaural_autotune(). If it holds an entry for the filter length,
+  /// its block size, kernel and FFT size fill in those of the three settings above that are
+  /// left on auto; explicit settings are kept. BINAURAL_KERNEL_Q15 takes nothing from it.
+  /// Defaults to BINAURAL_WISDOM_FILE, NULL uses the settings as given.
+  const char* wisdomPath;
+  uint32_t maxLatency;    ///< largest block size the wisdom may pick (default MAX_CONVOLVE_BLOCK_SIZE)
+  bool progress;          ///< print the chosen backend and progress to stdout (default true)
+  /// Directory of the rendered output cache (see render_cache.h). A render whose input data,
+  /// filter and settings were rendered before is linked from the cache instead of computed.
+  /// NULL (default) disables the cache.
+  const char* cacheDir;
+  uint64_t cacheMaxBytes; ///< cache size beyond which the least recently used outputs are evicted
+  /// Render only the input frames [startFrame, endFrame). The FILTER_SIZE - 1 frames before
+  /// startFrame are read as filter history, so with the direct kernel the output is bit-identical
+  /// to the same range cut from a render of the whole input. With the FFT kernel (which rounds
+  /// differently per block) or silence skipping that holds when startFrame is a multiple of the
+  /// block size: silent blocks are counted on the block grid ending at startFrame.
+  /// Defaults to 0 and UINT32_MAX, the whole input; endFrame is clamped to its length.
+  uint32_t startFrame;
+  uint32_t endFrame;
+  /// Sample format of the output file, TW_FLOAT32 (default), TW_INT16 or TW_FLAC24. With
+  /// TW_FLAC24 the output is quantised to 24 bits and its extension becomes .flac.
+  TinyWavSampleFormat outputFormat;
+  uint32_t encoderThreads; ///< threads encoding a TW_FLAC24 output (default 1)
+} BinauralOptions;
+
+void binaural_options_default(BinauralOptions* options);
+
+/**
+ * Resolve the settings a render of this filter actually uses: the wisdom entry for the
+ * filter's span (if any) applied to the settings left on auto, the rest of them defaulted,
+ * the block size clamped, and the FFT size made to fit.
+ * resolved->wisdomPath is NULL so the result can be used as is.
+ */
+void binaural_options_resolve(const BinauralOptions* options, const BinauralFilter* filter, BinauralOptions* resolved);
+
 void binaural_compute(int degrees, char* audio_file);
+
+/** As binaural_compute(), with the given render settings (NULL for the defaults). */
+void binaural_compute_ex(int degrees, char* audio_file, const BinauralOptions* options);
+
+/**
+ * Render shard `shard` (0 based) of `shards` of what binaural_compute_ex() would render, as the
+ * range output outputs/<degrees>_degrees_<start>-<end>_<file>. The range is split on whole
+ * blocks of the resolved block size, so the shards may run in separate processes or on
+ * machines sharing the file system (and wisdom file), in any order.
+ *
+ * @param options  Render settings as for binaural_compute_ex() (NULL for the defaults).
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_compute_shard(int degrees, char* audio_file, uint32_t shard, uint32_t shards, const BinauralOptions* options);
+
+/**
+ * Concatenate the data of all shards rendered by binaural_compute_shard() into the output
+ * binaural_compute_ex() would have written, patching the header sizes. Samples are copied,
+ * not decoded, so the result is byte-identical to a single render, with either kernel and
+ * with silence skipping. The shards are kept.
+ *
+ * @return  The error code. Zero if no error; a missing, incomplete or mismatched shard is an error.
+ */
+int binaural_stitch_shards(int degrees, char* audio_file, uint32_t shards, const BinauralOptions* options);
+
+/**
+ * Render many short clips for one direction in shared buffers: the clips are packed one after
+ * another, separated by FILTER_SIZE - 1 frames of silence, into buffers of BINAURAL_BATCH_FRAMES
+ * frames that are convolved in whole blocks, and each clip's part of the result is written to
+ * its own output, as binaural_compute_ex() names it. The filter is loaded once, no clip ends in
+ * a partial block of its own, and the next BINAURAL_BATCH_READAHEAD files are read ahead in the
+ * background. With the direct kernel each output is identical to rendering the clip alone.
+ * Clips longer than a buffer, int16 clips with BINAURAL_KERNEL_Q15, and every clip when
+ * silenceThreshold is positive (the skipped blocks depend on the clip's own block grid) are
+ * rendered alone as binaural_compute_ex() renders them, through the render cache. Time ranges
+ * do not apply, and packed clips are not cached.
+ *
+ * @param options  Render settings (NULL for the defaults).
+ *
+ * @return  The error code. Zero if every clip was rendered.
+ */
+int binaural_compute_batch(int degrees, char** audio_files, uint32_t count, const BinauralOptions* options);
+
+struct FftConv;
+
+/**
+ * Convolve an opened input block by block with the given LR filter and write the result to
+ * an opened output. The last FILTER_SIZE - 1 samples of each block are cached and prepended
+ * to the next one so that convolution is continuous across blocks; before the first block
+ * the cache is silence, or the input preceding options->startFrame. Safe to call from several threads at once with different files.
+ *
+ * @param tw       Input opened with TW_SPLIT, at most NUM_CHANNELS (2) channels.
+ * @param tw_out   Output opened with TW_SPLIT and 2 channels.
+ * @param options  Render settings, see binaural_options_default().
+ * @param plan     FFT plan already prepared for this filter (see fft_conv_init()) to reuse
+ *                 when the FFT kernel is selected, or NULL to prepare one for this call.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_render(TinyWav *tw, TinyWav *tw_out, BinauralFilter* filter, const BinauralOptions* options,
+    struct FftConv* plan);
+
+/**
+ * Render an opened input into a new file at output_path, the way binaural_compute_ex() does:
+ * in options->outputFormat, or through binaural_render_q15() to an int16 file when the kernel
+ * is BINAURAL_KERNEL_Q15 and the input is TW_INT16 (and the format is not TW_FLAC24).
+ *
+ * @param plan    As for binaural_render().
+ * @param frames  Receives the number of frames written, or NULL.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_render_to(TinyWav *tw, const char* output_path, BinauralFilter* filter, const BinauralOptions* options,
+    struct FftConv* plan, uint32_t* frames);
+
+struct BinauralFilterQ15;
+
+/**
+ * As binaural_render(), entirely in fixed point: int16 samples are read, convolved with the
+ * quantised filter (see fixed_conv.h) and written without any float conversion.
+ *
+ * @param tw       TW_INT16 input opened with TW_SPLIT, at most NUM_CHANNELS (2) channels.
+ * @param tw_out   TW_INT16 output opened with TW_SPLIT and 2 channels.
+ * @param options  Render settings; the kernel and FFT settings do not apply.
+ *
+ * @return  The error code. Zero if no error.
+ */
+int binaural_render_q15(TinyWav *tw, TinyWav *tw_out, const struct BinauralFilterQ15* filter,
+    const BinauralOptions* options);
+
+#define BINAURAL_Q15_MIN_SNR 70.0 // dB of the float render over the fixed-point difference (see test_render.c)
+
+/**
+ * Binaural render using a compiled multi-elevation HRIR database (see hrir_db.h).
+ * The filter is interpolated from the measurements surrounding the given direction.
+ *
+ * @param db_path     Path of the *.hrdb file.
+ * @param azimuth     Source azimuth in degrees.
+ * @param elevation   Source elevation in degrees.
+ * @param audio_file  The 2-channel wav file to convert. Output goes to outputs/.
+ */
+void binaural_compute_db(const char* db_path, float azimuth, float elevation, char* audio_file);
   
 #ifdef __cplusplus
 }
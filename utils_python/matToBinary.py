@@ -12,9 +12,20 @@
 # OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 # PERFORMANCE OF THIS SOFTWARE.
 
+import sys
+import struct
+import numpy as np
 import scipy.io
+from scipy.spatial import ConvexHull, QhullError, cKDTree
 from pathlib import Path
 
+# layout must match C/hrir_db.h
+HRIR_DB_VERSION = 1
+HRIR_DB_NONE = 0xFFFFFFFF
+HEADER_FORMAT = '<4s13I'
+PAGE_SIZE = 4096
+
+
 def matToBin():
     location = Path(__file__).absolute().parent
     for i in range(0, 360, 30):
@@ -25,7 +36,97 @@ def matToBin():
             for x in ir[:, j]:
                 f.write(x.tobytes())
         f.close()
-            
+
+
+def loadMatSet(mat_path):
+    """Load a multi-position set from a single .mat file holding
+    'hrir' (positions x channels x taps), 'azimuth' and 'elevation' (degrees)
+    and optionally 'fs'."""
+    mat = scipy.io.loadmat(mat_path)
+    hrir = np.asarray(mat['hrir'], dtype=np.float32)
+    az = np.asarray(mat['azimuth'], dtype=np.float64).ravel()
+    el = np.asarray(mat['elevation'], dtype=np.float64).ravel()
+    fs = int(np.asarray(mat['fs']).ravel()[0]) if 'fs' in mat else 48000
+    return hrir, az, el, fs
+
+
+def loadAzimuthSet(bin_dir, filter_size=256):
+    """Load the 12 azimuth-only <deg>_degrees.bin files as a set on the horizontal plane."""
+    hrir, az = [], []
+    for i in range(0, 360, 30):
+        h = np.fromfile(f'{bin_dir}/{i}_degrees.bin', dtype=np.float32)
+        hrir.append(h.reshape(2, filter_size))
+        az.append(i)
+    az = np.asarray(az, dtype=np.float64)
+    return np.asarray(hrir), az, np.zeros_like(az), 48000
+
+
+def unitVectors(az, el):
+    a, e = np.radians(az), np.radians(el)
+    return np.c_[np.cos(e) * np.cos(a), np.cos(e) * np.sin(a), np.sin(e)]
+
+
+def triangulate(xyz):
+    """Spherical Delaunay triangulation of unit vectors (their convex hull), with every
+    triangle wound counter-clockwise seen from outside so the C side can rotate around a vertex."""
+    try:
+        hull = ConvexHull(xyz)
+    except QhullError:
+        return np.zeros((0, 3), np.uint32), np.zeros((0, 3), np.uint32)
+    tri = hull.simplices.copy()
+    nbr = hull.neighbors.copy()
+    flip = np.einsum('ij,ij->i', xyz[tri[:, 0]], np.cross(xyz[tri[:, 1]], xyz[tri[:, 2]])) < 0
+    tri[flip, 1], tri[flip, 2] = tri[flip, 2], tri[flip, 1].copy()
+    nbr[flip, 1], nbr[flip, 2] = nbr[flip, 2], nbr[flip, 1].copy()
+    return tri.astype(np.uint32), nbr.astype(np.uint32)
+
+
+def matToDb(hrir, az, el, fs, out_path):
+    """Compile a set of HRIRs into a memory-mappable database with an equal-area grid
+    and a triangulation for nearest-neighbour and barycentric lookups (see C/hrir_db.h)."""
+    num_pos, num_ch, filter_size = hrir.shape
+    xyz = unitVectors(az, el)
+    tri, nbr = triangulate(xyz)
+
+    vertex_tri = np.full(num_pos, HRIR_DB_NONE, dtype=np.uint32)
+    for t, verts in enumerate(tri):
+        vertex_tri[verts] = t
+
+    # cylindrical equal-area grid: equal steps in z = sin(el) and in azimuth, ~2 cells per position
+    rows = max(1, int(np.ceil(np.sqrt(num_pos / 2))))
+    cols = 4 * rows
+    z = -1 + (np.arange(rows) + 0.5) * 2 / rows
+    a = (np.arange(cols) + 0.5) * 360 / cols
+    zz, aa = np.meshgrid(z, a, indexing='ij')
+    centres = unitVectors(aa.ravel(), np.degrees(np.arcsin(zz.ravel())))
+    _, grid = cKDTree(xyz).query(centres)
+
+    positions = np.c_[az, el, xyz].astype(np.float32)
+    offset = struct.calcsize(HEADER_FORMAT)
+    pos_off = offset
+    tri_off = pos_off + positions.nbytes
+    vtx_off = tri_off + tri.nbytes * 2
+    grid_off = vtx_off + vertex_tri.nbytes
+    filt_off = -(-(grid_off + grid.size * 4) // PAGE_SIZE) * PAGE_SIZE
+
+    with open(out_path, 'wb') as f:
+        f.write(struct.pack(HEADER_FORMAT, b'HRDB', HRIR_DB_VERSION, num_pos, len(tri), filter_size,
+                            num_ch, fs, rows, cols, pos_off, tri_off, vtx_off, grid_off, filt_off))
+        f.write(positions.tobytes())
+        f.write(np.c_[tri, nbr].astype('<u4').tobytes())
+        f.write(vertex_tri.astype('<u4').tobytes())
+        f.write(grid.astype('<u4').tobytes())
+        f.write(b'\0' * (filt_off - f.tell()))
+        f.write(hrir.astype('<f4').tobytes())
+    print(f'{out_path}: {num_pos} positions, {len(tri)} triangles, {rows}x{cols} grid')
+
 
 if __name__ == '__main__':
-    matToBin()
\ No newline at end of file
+    location = Path(__file__).absolute().parent
+    if len(sys.argv) == 3:
+        # python matToBinary.py <set.mat> <out.hrdb>
+        matToDb(*loadMatSet(sys.argv[1]), sys.argv[2])
+    elif len(sys.argv) == 2 and sys.argv[1] == 'db':
+        matToDb(*loadAzimuthSet(f'{location}/dataset_bin'), f'{location}/dataset_bin/hrir.hrdb')
+    else:
+        matToBin()
@@ -0,0 +1,84 @@
+# Copyright (c) 2024, Gia Minh Nguyen (Giaminhnguyen.2004@gmail.com) (u7556893@anu.edu.au)
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+
+# Split every <deg>_degrees.bin into a pure delay plus a minimum-phase filter truncated
+# where its remaining energy falls below a threshold, and write <deg>_degrees.min.bin:
+#
+#   uint32 delay_l, uint32 taps_l, uint32 delay_r, uint32 taps_r
+#   float32[taps_l] left filter, float32[taps_r] right filter
+#
+# The C renderer picks up a .min.bin next to the .bin automatically.
+#
+# usage: python trim_hrir.py [dataset_bin dir] [tail threshold in dB] [onset threshold in dB]
+# The directory defaults to C/dataset_bin, the one the renderer reads.
+
+import sys
+import struct
+import numpy as np
+from pathlib import Path
+
+FILTER_SIZE = 256
+
+
+def onsetDelay(h, onset_db):
+    """Index of the first sample within onset_db of the peak."""
+    level = np.abs(h).max() * 10 ** (-onset_db / 20)
+    return int(np.argmax(np.abs(h) >= level))
+
+
+def minimumPhase(h, nfft=None):
+    """Minimum-phase filter with the same magnitude response as h (real cepstrum method)."""
+    n = len(h)
+    nfft = nfft or 8 * n
+    spectrum = np.abs(np.fft.fft(h, nfft))
+    cepstrum = np.fft.ifft(np.log(np.maximum(spectrum, 1e-10))).real
+    # fold the anti-causal part of the cepstrum onto the causal part
+    fold = np.zeros(nfft)
+    fold[0] = cepstrum[0]
+    fold[1:nfft // 2] = 2 * cepstrum[1:nfft // 2]
+    fold[nfft // 2] = cepstrum[nfft // 2]
+    return np.fft.ifft(np.exp(np.fft.fft(fold))).real[:n]
+
+
+def trimTail(h, tail_db):
+    """Shortest prefix of h holding all but tail_db of its energy."""
+    energy = np.cumsum(h ** 2)
+    keep = 1 - 10 ** (-tail_db / 10)
+    return h[:int(np.searchsorted(energy, keep * energy[-1])) + 1]
+
+
+def trimHrir(h, tail_db=30, onset_db=20):
+    delay = onsetDelay(h, onset_db)
+    taps = trimTail(minimumPhase(h), tail_db)
+    delay = min(delay, FILTER_SIZE - len(taps))  # delay + taps must fit the renderer's history
+    return delay, taps.astype(np.float32)
+
+
+def trimDataset(bin_dir, tail_db=30, onset_db=20):
+    for i in range(0, 360, 30):
+        h = np.fromfile(f'{bin_dir}/{i}_degrees.bin', dtype=np.float32).reshape(2, FILTER_SIZE)
+        (delay_l, taps_l), (delay_r, taps_r) = (trimHrir(h[c], tail_db, onset_db) for c in range(2))
+        with open(f'{bin_dir}/{i}_degrees.min.bin', 'wb') as f:
+            f.write(struct.pack('<4I', delay_l, len(taps_l), delay_r, len(taps_r)))
+            f.write(taps_l.astype('<f4').tobytes())
+            f.write(taps_r.astype('<f4').tobytes())
+        print(f'{i}_degrees: left {delay_l} + {len(taps_l)} taps, right {delay_r} + {len(taps_r)} taps')
+
+
+if __name__ == '__main__':
+    location = Path(__file__).absolute().parent
+    bin_dir = sys.argv[1] if len(sys.argv) > 1 else f'{location.parent}/C/dataset_bin'
+    tail_db = float(sys.argv[2]) if len(sys.argv) > 2 else 30
+    onset_db = float(sys.argv[3]) if len(sys.argv) > 3 else 20
+    trimDataset(bin_dir, tail_db, onset_db)